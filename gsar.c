@@ -1,1076 +1,3491 @@
-/* gsar.c
- *
- * Description : General Search And Replace utility (gsar)
- * Author      : Tormod Tjaberg & Hans Peter Verne
- *
- * Copyright (C) 1992-2020 Tormod Tjaberg & Hans Peter Verne,
- * This is free software, distributed under the terms of the
- * GNU General Public License. For details see the file COPYING
- */
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-#include <stdarg.h>
-#include <limits.h>
-#include <signal.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include "comp_dep.h"
-#include "arg_func.h"
-#include "gsar.h"
-
-#define PROGRAM_NAME "gsar"
-#define PROGRAM_VER  "1.51"
-
-/* Need setmode to turn my streams into binary Under MS-DOS
- */
-#ifdef MSDOS
-    #include <fcntl.h>
-    #include <io.h>
-#endif
-
-#ifdef __UNIX__
-    #include <unistd.h>
-#endif
-
-/* Clever little option mimic wildcard expansion from
- * shell ONLY available with the Zortech compiler ver 3.0x and upwards
- * And in the Symantec compiler though it's been renamed
- */
-#if defined(__ZTC__)
-    #include <dos.h>
-    #ifdef WILDCARDS
-        WILDCARDS
-    #endif
-    #ifdef EXPAND_WILDCARDS
-        EXPAND_WILDCARDS
-    #endif
-#endif
-
-#if defined(__MINGW32__) || defined(__MINGW64__)
-    int _dowildcard = -1;
-#endif
-
-/* Macro to determine if char is a path or drive delimiter
- */
-#define IS_PATH_DELIM(c)   ((c) == '\\' || (c) == ':' || (c) == '/')
-
-#define LF  0xa
-#define CR  0xd
-
-#define SETVBUF_SIZ  0x4000
-
-unsigned int nItemsSearch = 0;
-unsigned int nItemsReplace = 0;
-
-/* if the flag below is set we are not allowed to interrupt!
- */
-#if defined(__UNIX__)
-    /* SunOS does not have this definition, so play it safe */
-    static int fCriticalPart = 0;
-#else
-    static sig_atomic_t fCriticalPart = 0;
-#endif
-
-OUTPUT_CTRL Ctrl;
-
-char **pFileList;           /* list of files found on the command line */
-char *pOutFile = NULL;      /* current output file name make sure it's NULL */
-char  SearchBuf[PAT_BUFSIZ] = "";
-char  ReplaceBuf[PAT_BUFSIZ] = "";
-
-static int  fFolded        = 0;  /* fold pattern ie. ignore case */
-static int  fOverWrite     = 0;  /* overwrite input file */
-static int  fSearchReplace = 0;  /* default to a search initially */
-static int  fForce         = 0;  /* force overwrite of existing output file */
-static int  fBuffers       = 0;  /* just display search & replace buffers */
-static int  fFilter        = 0;  /* make GSAR act like a filter */
-static int  fWideString    = 0;  /* modifier, pad buffers with zero, little-endian (widechar) */
-static int  fStringAsHex   = 0;  /* modifier, parse buffers as hexadecimal */
-
-
-/* Usage text and GNU licence information
- */
-char *Usage[] =
-{
-    PROGRAM_NAME ", ver " PROGRAM_VER " -- Copyright (C) 1992-2020 Tormod Tjaberg & Hans Peter Verne",
-    "",
-    "Usage: gsar [options] [infile(s)] [outfile]",
-    "Options are:",
-    "-s<string> Search string ",
-    "-r[string] Replace string. Use '-r' to delete the search string from the file",
-    "-w         convert string to Wide character string (little-endian)",
-    "-X         interpret string as raw heX bytes",
-    "-i         Ignore case difference when comparing strings",
-    "-B         just display search & replace Buffers",
-    "-f         Force overwrite of an existing output file",
-    "-o         Overwrite the existing input file",
-    "-c[n]      show textual Context of match, 'n' is number of bytes in context",
-    "-x[n]      show context as a heX dump, 'n' is number of bytes in context",
-    "-b         display Byte offsets of matches in file",
-    "-l         only List filespec and number of matches (default)",
-    "-h         suppress display of filespec when displaying context or offsets",
-    "-du        convert a DOS ASCII file to UNIX (strips carriage return)",
-    "-ud        convert a UNIX ASCII file to DOS (adds carriage return)",
-    "-F         'Filter' mode, input from stdin and eventual output to stdout",
-    "-G         display the GNU General Public Licence",
-    "",
-    "Ctrl characters may be entered by using a ':' in the string followed by the",
-    "ASCII value of the character. The value is entered using ':' followed by three",
-    "decimal digits or ':x' followed by two hex numbers. To enter ':' use '::'",
-    NULL
-};
-
-char *Licence[] =
-{
-    "This program is free software; you can redistribute it and/or modify",
-    "it under the terms of the GNU General Public License as published by",
-    "the Free Software Foundation; either version 2 of the License, or",
-    "(at your option) any later version.",
-    "",
-    "This program is distributed in the hope that it will be useful,",
-    "but WITHOUT ANY WARRANTY; without even the implied warranty of",
-    "MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the",
-    "GNU General Public License for more details.",
-    "",
-    "You should have received a copy of the GNU General Public License",
-    "with this program; if not, write to the Free Software Foundation, Inc.,",
-    "51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.",
-    NULL
-};
-
-
-/* Display the GNU General Public License
- */
-void ShowLicence(void)
-{
-    int i = 0;
-
-    while (Licence[i] != NULL)
-    {
-        fputs(Licence[i++], Ctrl.fpMsg);
-        fputc('\n', Ctrl.fpMsg);
-    }
-}
-
-
-/* Input  : Message to be displayed with the format of standard printf
- * Returns: Nothing, but instead it exits to operating system
- *
- * Terminate program, return to OS with a suitable return value
- * exit() will close all open files. All fatal errors are written
- * to stderr.
- */
-void Abort(const char *pMessage, ...)
-{
-    va_list argp;
-
-    fprintf(stderr, "gsar: ");
-    va_start(argp, pMessage);
-    vfprintf(stderr, pMessage, argp);
-    va_end(argp);
-    fprintf(stderr, "\n");
-    exit(EXIT_FAILURE);  /* exit & tell operating system that we've failed */
-}
-
-
-/* Ctrl-Break handler. Returns to operating system
- */
-void CtrlBreak(int Val)
-{
-    if (fCriticalPart)
-        return;
-
-    signal(SIGINT, SIG_IGN);
-
-    /* Before we die try to clean up as much as possible
-     * make sure we don't delete stdout...
-     */
-    if (fSearchReplace && pOutFile != NULL && !fFilter)
-        remove(pOutFile);
-
-    exit(EXIT_FAILURE);  /* exit & tell operating system that we've failed */
-}
-
-
-/* Input  : pActStr - pointer to actual string which is to be duplicated
- * Returns: pDupStr - pointer to malloc'd duplicate
- *          NULL - Out of memory
- *
- * Duplicates a string by malloc'ing and then doing a strcpy
- */
-char *DupStr(char *pActStr)
-{
-    register char *pDupStr;
-
-    pDupStr = (char *) malloc(strlen(pActStr) + 1);
-    if (pDupStr)
-        strcpy(pDupStr, pActStr);
-    return pDupStr;
-}
-
-
-/* Input  : filespec - a filespec which contains a path and a filename
- * Returns: savfilespec - pointer to malloc'd string with path
- *
- * Extracts the path from a filespec
- */
-char *ExtractPathFromFSpec(register char *filespec)
-{
-    register char *p;
-    register char *savfilespec;
-
-    savfilespec = DupStr(filespec); /* avoid destroying the original */
-
-    /* Start at end of string and back up till we find the beginning */
-    /* of the filename or a path.               */
-    for (p = savfilespec + strlen(savfilespec);
-         p != savfilespec && !IS_PATH_DELIM(*(p - 1));
-         p--)
-        ;
-    *p = '\0';
-    return savfilespec;
-}
-
-
-/* Input  : pPath - which has to be properly terminated
- *          pPrefix - tmp filename prefix maximum 4 chars
- * Returns: pointer to static buffer
- *          NULL - unable to generate tmp file name
- *
- * Generates a temporary filename by combining an optional path,
- * a prefix ,a number between 0 & SHRT_MAX and the suffix '.tmp'.
- */
-char *TmpName(char *pPath, char *pPrefix)
-{
-    static char FileSpec[FILENAME_MAX ];
-    static char Seed = 0;
-
-    static int TmpNum;
-    char *pDigits;
-    unsigned int i;
-    struct stat buf;
-
-    *FileSpec = '\0'; /* Null terminate the buffer so strcat will always work */
-    if (!Seed)      /* if first time through */
-    {
-        Seed++;
-        TmpNum = -1; /* since we increment this will make the first number 0000 */
-    }
-
-    if (pPath != NULL)
-        strcpy(FileSpec, pPath);     /* first the path  */
-    if (pPrefix != NULL)
-        strcat(FileSpec, pPrefix);   /* then the prefix */
-
-    /* pointer to start of digits in filespec */
-    pDigits = FileSpec + strlen(FileSpec);
-
-    for (i = 0; i <= SHRT_MAX; i++)     /* try SHRT_MAX times */
-    {
-        TmpNum++;                        /* TmpNum is static ! */
-        sprintf(pDigits, "%04x", TmpNum);/* convert to string */
-        strcat(FileSpec, ".tmp");        /* add the suffix */
-        if (stat(FileSpec, &buf) != 0)
-            return FileSpec;                /* file not found, success */
-        *(pDigits) = '\0';               /* pre_XXXX --> pre_ */
-    }
-    /* unable to create a temporary file ! more than SHRT_MAX files !!*/
-    return NULL;
-}
-
-
-/* Input    : pBuffer pointer to character buffer
- *            nItem number of items in buffer
- *            base  1 = hex , 0 = ASCII
- * Returns  : nothing
- *
- * Prints the contents of a buffer in either ASCII or HEX. The
- * nItems variable is needed since we don't stop on a NUL
- */
-void DumpBuffer(char *pBuffer, unsigned int nItem, unsigned char Base)
-{
-    unsigned int i;                 /* loop counter */
-
-    if (!Base)
-    {
-        for (i = 0; i < nItem; i++)
-        {
-            if (isprint((int) * pBuffer))
-                fputc(*pBuffer, Ctrl.fpMsg);
-            else
-                fputc('.', Ctrl.fpMsg);
-
-            pBuffer++;
-        }
-    }
-    else
-        for (i = 0; i < nItem; i++)
-            fprintf(Ctrl.fpMsg, "%02x ", (unsigned char) * pBuffer++);
-
-    fputc('\n', Ctrl.fpMsg);
-}
-
-
-/* Input    : pArgStr - pointer to command line search or replace string
- *            pBuffer - pointer to buffer to store the parsed string
- * Returns  : actual length of parsed string
- *
- * Takes a string & transforms it into the correct internal representation
- * ie :070OO -> FOO or :x46OO -> FOO
- */
-unsigned int GetPattern(char *pArgStr, char *pBuffer)
-{
-    char  number[4 ];/* array to store number to convert */
-    char *pEnd;      /* pointer to the result of the string to long conversion */
-    char *pStart;    /* pointer to the start of the buffer */
-
-    pStart = pBuffer;
-    number[3] = '\0'; /* make sure number buffer is terminated */
-
-    while (*pArgStr != '\0')
-    {
-        if (*pArgStr != ':')
-            *pBuffer++ = *pArgStr++;       /* just copy the buffer */
-        else
-        {
-            if (*(pArgStr + 1) == ':')    /* check for multiple :'s */
-            {
-                *pBuffer++ = *pArgStr;
-                pArgStr = pArgStr + 2;       /* position ourselves past the 2 :'s */
-            }
-            else
-            {
-                /* have we actually got three chars to copy ? */
-                if (strlen(++pArgStr) > 2)
-                {
-                    memcpy(number, pArgStr, 3);/* negative numbers are silently ignored*/
-                    pArgStr += 3;              /* jump past this number in the argument string */
-                    if ((char) tolower(number[0]) == 'x')
-                    {
-                        /* perform hex conversion */
-                        number[0] = '0';        /* replace the x with a zero */
-                        *pBuffer++ = (char) strtol(number, &pEnd, 16);
-                        if (pEnd != number + 3)
-                            Abort("command error, not a valid hexadecimal number : %s\n", &number[1]);
-                    }
-                    else                       /* decimal conversion */
-                    {
-                        *pBuffer++ = (char) strtol(number, &pEnd, 10);
-                        if (pEnd != number + 3)
-                            Abort("command error, not a valid decimal number : %s\n", number);
-                    }
-                }
-                else                          /* strlen(pArgStr) < 3 so abort */
-                    Abort("command error, a single colon must be followed by three decimal digits or an 'x' followed by 2 hexadecimal numbers\n");
-            }
-        }
-        if (pBuffer - pStart > PAT_BUFSIZ)
-            Abort("command error, length of search or replace buffer must not exceed %d bytes", PAT_BUFSIZ);
-    }  /* while */
-    return pBuffer - pStart;               /* actual length of buffer */
-}
-
-
-unsigned char Text2Byte(const unsigned char *p)
-{
-    int x;
-    int y;
-    unsigned char b;
-
-    /* Convert textual representation to an int, trivial ;) */
-    x = toupper(p[0]) - '0';
-    x -= (x > 9) ? 7 : 0;
-
-    y = toupper(p[1]) - '0';
-    y -= (y > 9) ? 7 : 0;
-
-    b = ((x & 0xf) << 4) | (y & 0xf);
-
-    return b;
-}
-
-
-int ParseHexLine(const char *pIn, char *pOut)
-{
-    int i = 0;
-    int j = 0;
-
-    if (strlen(pIn) & 1)
-    {
-        Abort("command error, hex string cannot have an odd number of characters");
-    }
-
-    for (i = 0; pIn[i] != 0; i++)
-    {
-        if (!isxdigit((int) pIn[i]))
-        {
-            Abort("command error, not a valid hexadecimal digit : %c", pIn[i]);
-        }
-
-        pOut[j] = (char) Text2Byte((const unsigned char *) &pIn[i]);
-        i++;
-        j++;
-    }
-
-    return j;
-}
-
-
-void DoExpansion(char *pBuf, int Len)
-{
-    int i;
-    int j;
-    char TmpBuf[PAT_BUFSIZ];
-
-    if ((Len * 2) > PAT_BUFSIZ)
-    {
-        Abort("command error, expanded buffer cannot exceed %d bytes", PAT_BUFSIZ);
-    }
-
-    memcpy(TmpBuf, pBuf, Len);
-
-    for (i = 0, j = 0; i < Len; i++)
-    {
-        pBuf[j++] = TmpBuf[i];
-        pBuf[j++] = 0;
-    }
-}
-
-/* Input  : argc - number of arguments on the command line
- *          argv - pointer to the argument vevtor
- * Returns: number of actual filenames found
- *
- * Parses the command line & returns number of filenames found
- */
-int GetArgs(int argc, char *argv[])
-{
-    int   i = 0;
-    int   j = 0;          /* counters */
-    int   c;              /* switch char */
-    char *pEnd;           /* the result of the string to long conversion */
-    long  longVal;
-    const char OptStr[] = "|s::r::iBfoc::x::blhd::u::FGwX";
-
-
-    pFileList = NULL;
-
-    if (argc > 1)
-    {
-        int Done = 0;
-
-        /* Prescan the argument list to detect search and replace modifiers, it needs
-         * the same list as the main parser since BAD_CHAR would be returned if not
-         */
-        while ((c = GetOpt(argc, argv, OptStr)) != EOF && !Done)
-        {
-            switch (c)
-            {
-                case 'w':
-                    fWideString = 1;
-                    break;
-                case 'X':
-                    fStringAsHex = 1;
-                    break;
-                case BAD_CHAR:
-                case MISSING_ARG:
-                case MISSING_OPT:
-                    Done = 1;
-                    break;
-                default:
-                    break;
-            }
-        }
-
-        /* Reset scanner */
-        GetOpt(argc, argv, NULL);
-
-        while ((c = GetOpt(argc, argv, OptStr)) != EOF)
-        {
-            switch (c)
-            {
-                case '|':
-                    /* create a vector of file pointers */
-#if defined(__UNIX__)
-                    /* SunOS doesn't allow realloc to be called with NULL :-(
-                     * Insert extra test on unix systems...
-                     */
-                    if (pFileList == NULL)
-                        pFileList = (char **) malloc((j + 2) * sizeof(char *));
-                    else
-#endif
-                        pFileList = (char **) realloc(pFileList, (j + 2) * sizeof(char *));
-                    pFileList[j++] = pOptArg;
-                    pFileList[j] = NULL;   /* The C-standard specifies that argv[argc] == NULL */
-                    break;
-                case MISSING_ARG:
-                    Abort("command error, the '%c' option requires an argument", (unsigned char) CurOpt);
-                    break;
-                case BAD_CHAR:
-                    Abort("command error, unknown option '%c'. Type 'gsar' by itself for help", (unsigned char) CurOpt);
-                    break;
-                case MISSING_OPT:
-                    i = 0;
-                    while (Usage[i] != NULL)
-                    {
-                        fputs(Usage[i++], Ctrl.fpMsg);
-                        fputc('\n', Ctrl.fpMsg);
-                    }
-                    exit(EXIT_SUCCESS);
-                    break;
-                case 's':
-                    if (pOptArg == NULL)
-                        Abort("command error, the '%c' option requires an argument", (unsigned char) CurOpt);
-
-                    if (fStringAsHex)
-                        nItemsSearch = ParseHexLine(pOptArg, SearchBuf);
-                    else
-                        nItemsSearch = GetPattern(pOptArg, SearchBuf);
-
-                    if (fWideString && nItemsSearch)
-                    {
-                        DoExpansion(SearchBuf, nItemsSearch);
-                        nItemsSearch *= 2;
-                    }
-                    break;
-                case 'r':
-                    if (pOptArg == NULL)
-                        nItemsReplace = 0;    /* we are to remove occurrence of -s */
-                    else
-                    {
-                        if (fStringAsHex)
-                            nItemsReplace = ParseHexLine(pOptArg, ReplaceBuf);
-                        else
-                            nItemsReplace = GetPattern(pOptArg, ReplaceBuf);
-
-                        if (fWideString && nItemsReplace)
-                        {
-                            DoExpansion(ReplaceBuf, nItemsReplace);
-                            nItemsReplace *= 2;
-                        }
-                    }
-
-                    fSearchReplace = 1;    /* only search & replace if -r option */
-                    break;
-                case 'u':                  /* replace LF with CR LF */
-                    if (pOptArg == NULL)
-                        pOptArg = "";
-                    if (!(*pOptArg == 'd' && *(pOptArg + 1) == '\0'))
-                        Abort("command error, unknown option 'u%s'. Type 'gsar' by itself for help", pOptArg);
-                    fSearchReplace = 1;
-                    nItemsSearch = 1;
-                    SearchBuf[0] = LF;
-                    nItemsReplace = 2;
-                    ReplaceBuf[0] = CR;
-                    ReplaceBuf[1] = LF;
-                    break;
-                case 'd':                  /* replace CR LF with LF */
-                    if (pOptArg == NULL)
-                        pOptArg = "";
-                    if (!(*pOptArg == 'u' && *(pOptArg + 1) == '\0'))
-                        Abort("command error, unknown option 'd%s'. Type 'gsar' by itself for help", pOptArg);
-                    fSearchReplace = 1;
-                    nItemsSearch = 2;
-                    SearchBuf[0] = CR;
-                    SearchBuf[1] = LF;
-                    nItemsReplace = 1;
-                    ReplaceBuf[0] = LF;
-                    break;
-                case 'i':
-                    fFolded = 1;
-                    break;
-                case 'G':
-                    ShowLicence();
-                    exit(EXIT_SUCCESS);
-                    break;
-                case 'l':
-                    Ctrl.fTextual = 0;      /* return to terse display */
-                    Ctrl.fHex = 0;
-                    Ctrl.fByteOffset = 0;
-                    break;
-                case 'o':
-                    fOverWrite = 1;
-                    break;
-                case 'f':
-                    fForce = 1;
-                    break;
-                case 'F':
-                    fFilter = 1;
-                    break;
-                case 'B':
-                    fBuffers = 1;
-                    break;
-                case 'b':
-                    Ctrl.fByteOffset = 1;    /* display file offset */
-                    break;
-                case 'h':
-                    Ctrl.fFileSpec = 0;      /* turn off filespec */
-                    break;
-                case 'x':
-                    Ctrl.fTextual = -1;      /* signal fall through */
-                    Ctrl.fHex = 1;           /* display context in hex */
-                case 'c':
-                    if (Ctrl.fTextual == -1)  /* entered through case 'x' */
-                        Ctrl.fTextual = 0;        /* reset sentinel value  */
-                    else
-                    {
-                        Ctrl.fHex = 0;        /* entered through case 'c' */
-                        Ctrl.fTextual = 1;    /* display textual context */
-                    }
-
-                    if (pOptArg == NULL)
-                        Ctrl.Context = (Ctrl.fHex == 1) ? HEX_CONTEXT : TXT_CONTEXT;
-                    else
-                    {
-                        longVal = strtol(pOptArg, &pEnd, 0);
-                        if (*pEnd != '\0')
-                            Abort("command error, invalid number : %s", pOptArg);
-
-                        if (longVal < 16 || longVal > BUFSIZ)
-                            Abort("command error, context size must be in the range 16 to %d", BUFSIZ);
-
-                        if (longVal > USHRT_MAX)
-                            Ctrl.Context = USHRT_MAX;
-                        else
-                            Ctrl.Context = (unsigned int) longVal;
-                    }
-                    break;
-                case 'w':
-                case 'X':
-                    /* we have to catch these as well but do nothing */
-                    break;
-                default:
-                    Abort("internal error, option '%c' not handled in switch", (unsigned char) CurOpt);
-                    break;
-            }
-        }
-    }
-    else
-    {
-        i = 0;
-        while (Usage[i] != NULL)
-        {
-            fputs(Usage[i++], Ctrl.fpMsg);
-            fputc('\n', Ctrl.fpMsg);
-        }
-        exit(EXIT_SUCCESS);
-    }
-
-    Ctrl.fVerbose = (Ctrl.fTextual ||
-                     Ctrl.fHex ||
-                     Ctrl.fByteOffset) ? 1 : 0;
-
-    return j;
-}
-
-
-
-/* Perform search or replace using stdin and stdout ie as a 'filter'
- * When gsar operates as a filter all output ie context, byte filenames
- * etc are all sent to stderr.
- */
-void StreamSearchReplace(void)
-{
-    long  nMatches;
-
-    Ctrl.pInputFile = "stdin";      /* proper filename   */
-    Ctrl.fpMsg = stderr;            /* redirect messages */
-
-#ifdef MSDOS
-    /* when MSDOS operates on streams it translates characters and terminates
-     * input and output when it encounters a CTRL Z. The code below makes
-     * MSDOS treat the streams as binary. Stdin cannot be used since MSDOS
-     * ignores the CTRL-Z. If you pipe a binary stream to MSDOS under some
-     * compilers you might get a write error (BCC, Zortech)
-     */
-    if (isatty(fileno(stdin)))
-        Abort("error, input from tty is not supported under MSDOS");
-    setmode(fileno(stdin), O_BINARY);
-    setmode(fileno(stdout), O_BINARY);
-#endif
-
-    Ctrl.fpIn = stdin;              /* input from stdin  */
-    Ctrl.fpOut = stdout;            /* output to stdout  */
-
-    if (!fSearchReplace)
-    {
-        nMatches = BMG_Search(&Ctrl);
-
-        if (nMatches > 0)
-            fprintf(Ctrl.fpMsg, "%s: %ld match%s found\n",
-                    Ctrl.pInputFile, nMatches, (nMatches == 1) ? "" : "es");
-    }
-    else
-    {
-        nMatches = BMG_SearchReplace(&Ctrl, ReplaceBuf, nItemsReplace);
-
-        if (nMatches == -1)   /* error in writing file */
-            Abort("error in writing file to stdout\n");
-        else if (nMatches > 1)
-        {
-            fflush(Ctrl.fpOut);
-            fprintf(Ctrl.fpMsg, "%s: %ld occurrence%s changed\n",
-                    Ctrl.pInputFile, nMatches, (nMatches > 1) ? "s" : "");
-        }
-    }
-}
-
-/* Input  : filename
- * Returns: 1 - file is OK, i.e we get a stat on it and it's a regular file
- *          0 - file is NOK
- *
- * Eventual errors are displayed here
- */
-char fCheckFile(char *pFileName)
-{
-    struct stat buf;
-
-    if (stat(pFileName, &buf) != 0)
-    {
-        fprintf(Ctrl.fpMsg, "gsar: unable to open input file '%s'\n", pFileName);
-        return 0;
-    }
-
-
-    /* If it's not a regular file */
-    if (!S_ISREG(buf.st_mode))
-    {
-        /* If it's NOT a dircetory flag warning */
-        if (!S_ISDIR(buf.st_mode))
-        {
-            fprintf(Ctrl.fpMsg, "gsar: warning, not a regular file '%s'\n", pFileName);
-        }
-        return 0;
-    }
-
-    return 1;
-}
-
-/* Performs a BMG search on one or multiple files. The files
- * to process are found in pFileList. Files that cannot be
- * opened are just ignored.
- */
-void FileSearch(void)
-{
-    long  nMatches;
-
-    while (*pFileList != NULL)
-    {
-        Ctrl.pInputFile = *pFileList++;
-
-        if (!fCheckFile(Ctrl.pInputFile))
-            continue;
-
-        if ((Ctrl.fpIn = fopen(Ctrl.pInputFile, "rb")) == NULL)
-        {
-            fprintf(Ctrl.fpMsg, "gsar: unable to open input file '%s'\n", Ctrl.pInputFile);
-            continue;
-        }
-
-        Ctrl.fpMsg = stdout;
-
-#if defined(MSDOS) && (!defined(__ZTC__)) || (defined(__ZTC__) && !defined(__SMALL__))
-        /* Don't use setvbuf if we're compiling under Zortech small model
-         */
-        if (setvbuf(Ctrl.fpIn, NULL, _IOFBF, SETVBUF_SIZ) != 0)
-            fprintf(Ctrl.fpMsg, "warning, unable to set up buffering for input file\n");
-#endif
-
-        nMatches = BMG_Search(&Ctrl);
-        fclose(Ctrl.fpIn);
-
-        if (nMatches > 0)
-            fprintf(Ctrl.fpMsg, "%s: %ld match%s found\n",
-                    Ctrl.pInputFile, nMatches, (nMatches == 1) ? "" : "es");
-    }
-}
-
-/* Performs a search and replace on a specific outputfile
- */
-void OneSearchReplace(void)
-{
-    long  nMatches = 0;
-    struct stat StatBuf;    /* struct so we can access file information */
-
-    Ctrl.fpMsg = stdout;    /* redirect messages */
-    Ctrl.pInputFile = NULL; /* initially we haven't found a file */
-
-    /* find the input and output file
-     */
-    while (*pFileList != NULL)
-    {
-        if (Ctrl.pInputFile == NULL)
-            Ctrl.pInputFile = *pFileList;
-        else if (pOutFile == NULL)
-            pOutFile = *pFileList;
-
-        pFileList++;
-    }
-
-    if (!fCheckFile(Ctrl.pInputFile))
-    {
-        /* Message has already been given */
-        exit(EXIT_FAILURE);
-    }
-    else
-        Ctrl.fpIn = fopen(Ctrl.pInputFile, "rb");
-
-    if (Ctrl.fpIn == NULL)
-        Abort("error, unable to open input file '%s'", Ctrl.pInputFile);
-
-    if ((stat(pOutFile, &StatBuf)) == 0 && !fForce)   /* stat got the info ie. file exists */
-        Abort("error, output file '%s' already exists. Use the 'f' option to force overwrite", pOutFile);
-
-    if ((Ctrl.fpOut = fopen(pOutFile, "wb")) == NULL)
-        Abort("error, unable to open output file '%s' ", pOutFile);
-
-#if defined(MSDOS) && (!defined(__ZTC__)) || (defined(__ZTC__) && !defined(__SMALL__))
-    /* Don't use setvbuf if we're compiling under Zortech small model
-     */
-    if (setvbuf(Ctrl.fpIn, NULL, _IOFBF, SETVBUF_SIZ) != 0)
-        fprintf(Ctrl.fpMsg, "warning, unable to set up buffering for input file\n");
-    if (setvbuf(Ctrl.fpOut, NULL, _IOFBF, SETVBUF_SIZ) != 0)
-        fprintf(Ctrl.fpMsg, "warning, unable to set up buffering for output file\n");
-#endif
-
-    nMatches = BMG_SearchReplace(&Ctrl, ReplaceBuf, nItemsReplace);
-
-    fclose(Ctrl.fpIn);
-    fclose(Ctrl.fpOut);
-
-    fCriticalPart = 1;    /* ignore interrupts here */
-
-    if (nMatches == -1)   /* error in writing file */
-    {
-        fprintf(Ctrl.fpMsg, "gsar: error in writing file '%s' - cleaning up\n", pOutFile);
-        if (remove(pOutFile) != 0)
-            Abort("error, unable to remove output file '%s'", pOutFile);
-        exit(EXIT_FAILURE);  /* exit & tell operating system that we've failed */
-    }
-
-    if (nMatches == 0)
-    {
-        if (remove(pOutFile) != 0)
-            Abort("error, unable to remove output file '%s'", pOutFile);
-    }
-    else
-        fprintf(Ctrl.fpMsg, "%s: %ld occurrence%s changed\n",
-                Ctrl.pInputFile, nMatches, (nMatches > 1) ? "s" : "");
-
-    /* Make sure the Ctrl-C handler does not delete a completly
-     * processed output file
-     */
-    pOutFile = NULL;
-
-    fCriticalPart = 0;   /* enable interrupts */
-}
-
-
-/* Performs a BMG search and replace on one or multiple files. The files
- * to process are found in pFileList. Files that cannot be opened
- * are ignored.
- */
-void SearchReplace(void)
-{
-    long  nMatches;
-#ifdef __UNIX__
-    struct stat stat_buf;
-    /*
-      - some compilers mess this up...
-      extern int chown(char *, uid_t, gid_t);
-      extern int chmod(char *, mode_t);
-    */
-#endif
-
-    Ctrl.fpMsg = stdout;    /* redirect messages */
-
-    while (*pFileList != NULL)
-    {
-        Ctrl.pInputFile = *pFileList++;
-
-        if (!fCheckFile(Ctrl.pInputFile))
-            continue;
-
-        if ((Ctrl.fpIn = fopen(Ctrl.pInputFile, "rb")) == NULL)
-        {
-            fprintf(Ctrl.fpMsg, "gsar: unable to open input file '%s'\n", Ctrl.pInputFile);
-            continue;
-        }
-
-        /* generate a temporary file name with prefix 'gsr_'
-           */
-        pOutFile = ExtractPathFromFSpec(Ctrl.pInputFile);
-        if ((pOutFile = TmpName(pOutFile, "gsr_")) == NULL)
-            Abort("error, unable to create a temporary file name");
-
-        if ((Ctrl.fpOut = fopen(pOutFile, "wb")) == NULL)
-            Abort("error, unable to open output file '%s' ", pOutFile);
-
-#ifdef __UNIX__
-        /* In Unix, we try to preserve the mode and id's of the file : */
-        if (stat(Ctrl.pInputFile, &stat_buf) != -1)
-        {
-            /* Get around gcc warnings */
-            if (chown(pOutFile, stat_buf.st_uid, stat_buf.st_gid)) {};
-            chmod(pOutFile, stat_buf.st_mode);
-        }
-        /* We just ignore errors here ... (hpv) */
-#endif
-
-#if defined(MSDOS) && (!defined(__ZTC__)) || (defined(__ZTC__) && !defined(__SMALL__))
-        /* Don't use setvbuf if we're compiling under Zortech small model
-           */
-        if (setvbuf(Ctrl.fpIn, NULL, _IOFBF, SETVBUF_SIZ) != 0)
-            fprintf(Ctrl.fpMsg, "warning, unable to set up buffering for input file\n");
-        if (setvbuf(Ctrl.fpOut, NULL, _IOFBF, SETVBUF_SIZ) != 0)
-            fprintf(Ctrl.fpMsg, "warning, unable to set up buffering for output file\n");
-#endif
-
-        nMatches = BMG_SearchReplace(&Ctrl, ReplaceBuf, nItemsReplace);
-
-        fclose(Ctrl.fpIn);
-        fclose(Ctrl.fpOut);
-
-        fCriticalPart = 1;    /* ignore interrupts here */
-
-        if (nMatches == -1)   /* error in writing file */
-        {
-            fprintf(Ctrl.fpMsg, "gsar: error in writing file '%s' - cleaning up\n", pOutFile);
-            if (remove(pOutFile) != 0)
-                Abort("error, unable to remove output file '%s'", pOutFile);
-            exit(EXIT_FAILURE);
-        }
-
-        if (nMatches == 0)
-        {
-            if (remove(pOutFile) != 0)
-                Abort("error, unable to remove output file '%s'", pOutFile);
-        }
-        else
-        {
-            /* if we can't remove the input file delete the tmp output file
-               */
-            if (remove(Ctrl.pInputFile) != 0)
-            {
-                fprintf(Ctrl.fpMsg, "gsar: error, unable to remove input file '%s' before rename (read-only ?)", Ctrl.pInputFile);
-                if (remove(pOutFile) != 0)
-                    Abort("error, unable to remove output file '%s'", pOutFile);
-                exit(EXIT_FAILURE);
-            }
-
-            if (rename(pOutFile, Ctrl.pInputFile) != 0)
-                Abort("error, unable to rename file '%s' to '%s'", pOutFile, Ctrl.pInputFile);
-
-            fprintf(Ctrl.fpMsg, "%s: %ld occurrence%s changed\n",
-                    Ctrl.pInputFile, nMatches, (nMatches > 1) ? "s" : "");
-        }
-        fCriticalPart = 0;
-    }
-}
-
-
-int main(int argc, char *argv[])
-{
-    int i;            /* number of files on command line */
-
-#if defined(__ZTC__)
-    /* Automatic response file expansion */
-    response_expand(&argc, &argv);
-#endif
-
-    Ctrl.fFileSpec = 1;
-    Ctrl.fpMsg = stdout;
-
-    if (signal(SIGINT, CtrlBreak) == SIG_ERR)
-        Abort("internal error, unable to set SIGINT");
-
-    /* parse command line arguments & set variables
-     * i is number of files found
-     */
-    i = GetArgs(argc, argv);
-
-    /* perform different health & sanity checks
-     */
-
-    if (nItemsSearch == 0)
-        Abort("command error, no search string specified");
-
-    /* display search and replace buffers if any
-     */
-    if (fBuffers)
-    {
-        fputc('\n', Ctrl.fpMsg);
-
-        fprintf(Ctrl.fpMsg, "Search buffer  (ASCII) : ");
-        DumpBuffer(SearchBuf, nItemsSearch, 0);
-        fprintf(Ctrl.fpMsg, "Length = %3d   (Hex)   : ", nItemsSearch);
-        DumpBuffer(SearchBuf, nItemsSearch, 1);
-        fprintf(Ctrl.fpMsg, "\n");
-
-        if (fSearchReplace)
-        {
-            if (nItemsReplace > 0)
-            {
-                fprintf(Ctrl.fpMsg, "Replace buffer (ASCII) : ");
-                DumpBuffer(ReplaceBuf, nItemsReplace, 0);
-                fprintf(Ctrl.fpMsg, "Length = %3d   (Hex)   : ", nItemsReplace);
-                DumpBuffer(ReplaceBuf, nItemsReplace, 1);
-            }
-            else
-                fprintf(Ctrl.fpMsg, "Note: Replace buffer is empty, search string will be removed from file!\n");
-        }
-
-        return EXIT_SUCCESS;
-    }
-
-    if (i == 0 && !fFilter)
-        Abort("command error, no input file name specified");
-
-    if (i != 2 && fForce && !fOverWrite)
-        Abort("command error, two file names are required to use the 'f' option");
-
-    /* set up the search pattern once and for all
-     */
-    BMG_Setup(SearchBuf, (int) nItemsSearch, fFolded);
-
-    if (fFilter)
-    {
-        if (fOverWrite || fForce)
-            Abort("command error, the 'o' or 'f' option is meaningless in 'filter' mode");
-
-        StreamSearchReplace();
-        return EXIT_SUCCESS;
-    }
-
-    /* just perform a file search
-     */
-    if (!fSearchReplace)
-    {
-        if (fOverWrite || fForce)
-            Abort("command error, the 'o' or 'f' option is meaningless in 'search' mode");
-
-        FileSearch();
-        return EXIT_SUCCESS;
-    }
-
-    /* Do a search and replace with specific output file
-     */
-    if (i == 2 && !fOverWrite && fSearchReplace)
-    {
-        OneSearchReplace();
-        return EXIT_SUCCESS;
-    }
-
-    if (!fOverWrite && fSearchReplace)
-        Abort("command error, multiple search & replace requires the 'o' option");
-
-    if (fOverWrite && fSearchReplace)
-    {
-        if (fForce)
-            Abort("command error, the 'f' option is meaningless in multiple search and replace");
-        SearchReplace();
-    }
-    return EXIT_SUCCESS;
-}
-
+/* gsar.c
+ *
+ * Description : General Search And Replace utility (gsar)
+ * Author      : Tormod Tjaberg & Hans Peter Verne
+ *
+ * Copyright (C) 1992-2020 Tormod Tjaberg & Hans Peter Verne,
+ * This is free software, distributed under the terms of the
+ * GNU General Public License. For details see the file COPYING
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "comp_dep.h"
+#include "arg_func.h"
+#include "gsar.h"
+
+#define PROGRAM_NAME "gsar"
+#define PROGRAM_VER  "1.51"
+
+/* Need setmode to turn my streams into binary Under MS-DOS
+ */
+#ifdef MSDOS
+    #include <fcntl.h>
+    #include <io.h>
+#endif
+
+#ifdef __UNIX__
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <pthread.h>
+    #include <dirent.h>
+    #include <fnmatch.h>
+#endif
+
+/* fcntl.h only shows this one with _GNU_SOURCE, but the fcntl itself
+ * has been in every Linux since 2.6.35
+ */
+#if defined(__linux__) && !defined(F_SETPIPE_SZ)
+    #define F_SETPIPE_SZ 1031
+#endif
+
+/* likewise hidden behind _GNU_SOURCE; in every Linux since 3.1 */
+#if defined(__linux__) && !defined(SEEK_HOLE)
+    #define SEEK_DATA 3
+    #define SEEK_HOLE 4
+#endif
+
+/* Clever little option mimic wildcard expansion from
+ * shell ONLY available with the Zortech compiler ver 3.0x and upwards
+ * And in the Symantec compiler though it's been renamed
+ */
+#if defined(__ZTC__)
+    #include <dos.h>
+    #ifdef WILDCARDS
+        WILDCARDS
+    #endif
+    #ifdef EXPAND_WILDCARDS
+        EXPAND_WILDCARDS
+    #endif
+#endif
+
+#if defined(__MINGW32__) || defined(__MINGW64__)
+    int _dowildcard = -1;
+#endif
+
+/* Macro to determine if char is a path or drive delimiter
+ */
+#define IS_PATH_DELIM(c)   ((c) == '\\' || (c) == ':' || (c) == '/')
+
+#define LF  0xa
+#define CR  0xd
+
+#define SETVBUF_SIZ  0x4000
+
+unsigned int nItemsSearch = 0;
+unsigned int nItemsReplace = 0;
+
+/* if the flag below is set we are not allowed to interrupt!
+ */
+#if defined(__UNIX__)
+    /* SunOS does not have this definition, so play it safe */
+    static int fCriticalPart = 0;
+#else
+    static sig_atomic_t fCriticalPart = 0;
+#endif
+
+OUTPUT_CTRL Ctrl;
+
+char **pFileList;           /* list of files found on the command line */
+char *pOutFile = NULL;      /* current output file name make sure it's NULL */
+static char DosSearch[2];   /* backing for the 'u' and 'd' presets */
+static char DosReplace[2];
+
+char *SearchBuf  = DosSearch;   /* alias of the first rule's patterns */
+char *ReplaceBuf = DosReplace;
+
+GSAR_RULE *pRules = NULL;   /* rules from repeated -s/-r pairs and rules files */
+unsigned int nRules = 0;    /* number of entries in pRules */
+
+static char **pRecurseDirs = NULL;  /* directories given with the 'R' option */
+static int    nRecurseDirs = 0;     /* number of entries in pRecurseDirs */
+static char **pNameGlobs = NULL;    /* file name globs, '!' prefix excludes */
+static int    nNameGlobs = 0;       /* number of entries in pNameGlobs */
+static char  *pFileListName = NULL; /* list file for the '@' option */
+static char  *pCacheName = NULL;    /* scan cache file for the 'k' option */
+static char  *pRecName   = NULL;    /* match record file for the 'O' option */
+
+static int  fFolded        = 0;  /* fold pattern ie. ignore case */
+static int  fOverWrite     = 0;  /* overwrite input file */
+static int  fSearchReplace = 0;  /* default to a search initially */
+static int  fForce         = 0;  /* force overwrite of existing output file */
+static int  fBuffers       = 0;  /* just display search & replace buffers */
+static int  fFilter        = 0;  /* make GSAR act like a filter */
+static int  fWideString    = 0;  /* modifier, pad buffers with zero, little-endian (widechar) */
+static int  fStringAsHex   = 0;  /* modifier, parse buffers as hexadecimal */
+static int  fUseMmap       = 0;  /* map input files instead of reading them */
+static int  fAsyncRead     = 0;  /* overlap reading with scanning */
+static int  fNoCache       = 0;  /* drop cache pages behind the scan */
+static int  fTextOnly      = 0;  /* skip files that look binary */
+static int  fSummary       = 0;  /* print an aggregate summary at the end */
+static int  nTopRank       = 0;  /* files in the match count ranking */
+static int  fProgress      = 0;  /* report progress while the run is going */
+static int  nProgSecs      = 2;  /* seconds between progress lines */
+static int  fQuiet         = 0;  /* existence check, exit status only */
+static int  fFoundMatch    = 0;  /* a match was found in some file */
+static int  fInPlace       = 0;  /* patch matches in place when same length */
+static int  fServe         = 0;  /* serve file names arriving on stdin */
+static int  nWorkers       = 1;  /* number of parallel worker threads */
+
+
+/* Usage text and GNU licence information
+ */
+char *Usage[] =
+{
+    PROGRAM_NAME ", ver " PROGRAM_VER " -- Copyright (C) 1992-2020 Tormod Tjaberg & Hans Peter Verne",
+    "",
+    "Usage: gsar [options] [infile(s)] [outfile]",
+    "Options are:",
+    "-s<string> Search string, may be repeated to search for several strings",
+    "-r[string] Replace string for the preceding '-s'. Use '-r' to delete the",
+    "           search string from the file",
+    "-p<file>   read search & replace Pairs from a file, one rule per line,",
+    "           search and replace separated by a TAB",
+    "-w         convert string to Wide character string (little-endian)",
+    "-X         interpret string as raw heX bytes",
+    "-i         Ignore case difference when comparing strings",
+    "-B         just display search & replace Buffers",
+    "-f         Force overwrite of an existing output file",
+    "-o         Overwrite the existing input file",
+    "-I         patch matches In place when search and replace strings have",
+    "           the same length, instead of rewriting the whole file",
+    "-c[n]      show textual Context of match, 'n' is number of bytes in context",
+    "-x[n]      show context as a heX dump, 'n' is number of bytes in context",
+    "-b         display Byte offsets of matches in file",
+    "-l         only List filespec and number of matches (default)",
+    "-q         Quiet existence check, stop at the first match and report",
+    "           found / not found through the exit status alone",
+    "-n<max>    stop searching each file after 'max' matches",
+    "-z         emit matches as machine readable records, filespec and decimal",
+    "           byte offset as NUL terminated fields",
+    "-D         serve mode, read file names from stdin and process each as it",
+    "           arrives, keeping the compiled pattern warm between files. One",
+    "           flushed summary line is written per name, matches or not",
+    "-h         suppress display of filespec when displaying context or offsets",
+    "-M         Map input files into memory when searching (Unix only)",
+    "-S         collect and display per file and total Search statistics",
+    "-T[n]      print an aggregate summary (Totals, rate) at the end of the",
+    "           run; with 'n', also the top 'n' files ranked by match count",
+    "-P[n]      report Progress on stderr while the run is going: files done,",
+    "           bytes processed and current rate, every 'n' seconds (default 2)",
+    "-k<file>   keep a scan cache in 'file': files unchanged since the last",
+    "           run with the same patterns (same size and mtime) are reported",
+    "           from the cache without being read",
+    "-O<file>   write every match to 'file' as a fixed size binary record,",
+    "           file id and byte Offset, with a table mapping ids to file",
+    "           names at the end; replaces the display formats (Unix only)",
+    "-A         overlap reading with scanning when searching, helps on",
+    "           storage with high latency (Unix only)",
+    "-C         drop the file Cache pages behind a scan, keeps one pass",
+    "           batch jobs from evicting other workloads (Unix only)",
+    "-t         Text only, skip files whose first block contains a zero",
+    "           byte instead of scanning them",
+    "-@<file>   read the names of the files to process from 'file', one",
+    "           per line or NUL separated; '-@-' reads the list from stdin",
+    "-R<dir>    Recurse into 'dir' and process every regular file found,",
+    "           may be repeated (Unix only)",
+    "-g<glob>   with 'R', only process file names matching 'glob'. A glob",
+    "           prefixed with '!' excludes instead. May be repeated",
+    "-m<size>   size of the search buffer in bytes, 'k', 'm' or 'g' may be",
+    "           appended as a multiplier",
+    "-j<n>      process files with 'n' parallel worker threads (Unix only)",
+    "-du        convert a DOS ASCII file to UNIX (strips carriage return)",
+    "-ud        convert a UNIX ASCII file to DOS (adds carriage return)",
+    "-F         'Filter' mode, input from stdin and eventual output to stdout",
+    "-G         display the GNU General Public Licence",
+    "",
+    "Ctrl characters may be entered by using a ':' in the string followed by the",
+    "ASCII value of the character. The value is entered using ':' followed by three",
+    "decimal digits or ':x' followed by two hex numbers. To enter ':' use '::'",
+    NULL
+};
+
+char *Licence[] =
+{
+    "This program is free software; you can redistribute it and/or modify",
+    "it under the terms of the GNU General Public License as published by",
+    "the Free Software Foundation; either version 2 of the License, or",
+    "(at your option) any later version.",
+    "",
+    "This program is distributed in the hope that it will be useful,",
+    "but WITHOUT ANY WARRANTY; without even the implied warranty of",
+    "MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the",
+    "GNU General Public License for more details.",
+    "",
+    "You should have received a copy of the GNU General Public License",
+    "with this program; if not, write to the Free Software Foundation, Inc.,",
+    "51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.",
+    NULL
+};
+
+
+/* Display the GNU General Public License
+ */
+void ShowLicence(void)
+{
+    int i = 0;
+
+    while (Licence[i] != NULL)
+    {
+        fputs(Licence[i++], Ctrl.fpMsg);
+        fputc('\n', Ctrl.fpMsg);
+    }
+}
+
+
+/* Input  : Message to be displayed with the format of standard printf
+ * Returns: Nothing, but instead it exits to operating system
+ *
+ * Terminate program, return to OS with a suitable return value
+ * exit() will close all open files. All fatal errors are written
+ * to stderr.
+ */
+void Abort(const char *pMessage, ...)
+{
+    va_list argp;
+
+    fprintf(stderr, "gsar: ");
+    va_start(argp, pMessage);
+    vfprintf(stderr, pMessage, argp);
+    va_end(argp);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);  /* exit & tell operating system that we've failed */
+}
+
+
+/* Ctrl-Break handler. Returns to operating system
+ */
+void CtrlBreak(int Val)
+{
+    if (fCriticalPart)
+        return;
+
+    signal(SIGINT, SIG_IGN);
+
+    /* Before we die try to clean up as much as possible
+     * make sure we don't delete stdout...
+     */
+    if (fSearchReplace && pOutFile != NULL && !fFilter)
+        remove(pOutFile);
+
+    exit(EXIT_FAILURE);  /* exit & tell operating system that we've failed */
+}
+
+
+/* Input  : pActStr - pointer to actual string which is to be duplicated
+ * Returns: pDupStr - pointer to malloc'd duplicate
+ *          NULL - Out of memory
+ *
+ * Duplicates a string by malloc'ing and then doing a strcpy
+ */
+char *DupStr(char *pActStr)
+{
+    register char *pDupStr;
+
+    pDupStr = (char *) malloc(strlen(pActStr) + 1);
+    if (pDupStr)
+        strcpy(pDupStr, pActStr);
+    return pDupStr;
+}
+
+
+/* Input  : filespec - a filespec which contains a path and a filename
+ * Returns: savfilespec - pointer to malloc'd string with path
+ *
+ * Extracts the path from a filespec
+ */
+char *ExtractPathFromFSpec(register char *filespec)
+{
+    register char *p;
+    register char *savfilespec;
+
+    savfilespec = DupStr(filespec); /* avoid destroying the original */
+
+    /* Start at end of string and back up till we find the beginning */
+    /* of the filename or a path.               */
+    for (p = savfilespec + strlen(savfilespec);
+         p != savfilespec && !IS_PATH_DELIM(*(p - 1));
+         p--)
+        ;
+    *p = '\0';
+    return savfilespec;
+}
+
+
+#ifdef MSDOS
+/* Input  : pPath - which has to be properly terminated
+ *          pPrefix - tmp filename prefix maximum 4 chars
+ * Returns: pointer to static buffer
+ *          NULL - unable to generate tmp file name
+ *
+ * Generates a temporary filename by combining an optional path,
+ * a prefix ,a number between 0 & SHRT_MAX and the suffix '.tmp'.
+ * Unix uses mkstemps() instead, so the probe loop below is only
+ * compiled for systems without it.
+ */
+char *TmpName(char *pPath, char *pPrefix)
+{
+    static char FileSpec[FILENAME_MAX ];
+    static char Seed = 0;
+
+    static int TmpNum;
+    char *pDigits;
+    unsigned int i;
+    struct stat buf;
+
+    *FileSpec = '\0'; /* Null terminate the buffer so strcat will always work */
+    if (!Seed)      /* if first time through */
+    {
+        Seed++;
+        TmpNum = -1; /* since we increment this will make the first number 0000 */
+    }
+
+    if (pPath != NULL)
+        strcpy(FileSpec, pPath);     /* first the path  */
+    if (pPrefix != NULL)
+        strcat(FileSpec, pPrefix);   /* then the prefix */
+
+    /* pointer to start of digits in filespec */
+    pDigits = FileSpec + strlen(FileSpec);
+
+    for (i = 0; i <= SHRT_MAX; i++)     /* try SHRT_MAX times */
+    {
+        TmpNum++;                        /* TmpNum is static ! */
+        sprintf(pDigits, "%04x", TmpNum);/* convert to string */
+        strcat(FileSpec, ".tmp");        /* add the suffix */
+        if (stat(FileSpec, &buf) != 0)
+            return FileSpec;                /* file not found, success */
+        *(pDigits) = '\0';               /* pre_XXXX --> pre_ */
+    }
+    /* unable to create a temporary file ! more than SHRT_MAX files !!*/
+    return NULL;
+}
+#endif /* MSDOS */
+
+
+/* Input    : pBuffer pointer to character buffer
+ *            nItem number of items in buffer
+ *            base  1 = hex , 0 = ASCII
+ * Returns  : nothing
+ *
+ * Prints the contents of a buffer in either ASCII or HEX. The
+ * nItems variable is needed since we don't stop on a NUL
+ */
+void DumpBuffer(char *pBuffer, unsigned int nItem, unsigned char Base)
+{
+    unsigned int i;                 /* loop counter */
+
+    if (!Base)
+    {
+        for (i = 0; i < nItem; i++)
+        {
+            if (isprint((int) * pBuffer))
+                fputc(*pBuffer, Ctrl.fpMsg);
+            else
+                fputc('.', Ctrl.fpMsg);
+
+            pBuffer++;
+        }
+    }
+    else
+        for (i = 0; i < nItem; i++)
+            fprintf(Ctrl.fpMsg, "%02x ", (unsigned char) * pBuffer++);
+
+    fputc('\n', Ctrl.fpMsg);
+}
+
+
+/* Input    : pArgStr - pointer to command line search or replace string
+ *            pBuffer - pointer to buffer to store the parsed string,
+ *                      must hold at least strlen(pArgStr) bytes
+ * Returns  : actual length of parsed string
+ *
+ * Takes a string & transforms it into the correct internal representation
+ * ie :070OO -> FOO or :x46OO -> FOO
+ */
+unsigned int GetPattern(char *pArgStr, char *pBuffer)
+{
+    char  number[4 ];/* array to store number to convert */
+    char *pEnd;      /* pointer to the result of the string to long conversion */
+    char *pStart;    /* pointer to the start of the buffer */
+
+    pStart = pBuffer;
+    number[3] = '\0'; /* make sure number buffer is terminated */
+
+    while (*pArgStr != '\0')
+    {
+        if (*pArgStr != ':')
+            *pBuffer++ = *pArgStr++;       /* just copy the buffer */
+        else
+        {
+            if (*(pArgStr + 1) == ':')    /* check for multiple :'s */
+            {
+                *pBuffer++ = *pArgStr;
+                pArgStr = pArgStr + 2;       /* position ourselves past the 2 :'s */
+            }
+            else
+            {
+                /* have we actually got three chars to copy ? */
+                if (strlen(++pArgStr) > 2)
+                {
+                    memcpy(number, pArgStr, 3);/* negative numbers are silently ignored*/
+                    pArgStr += 3;              /* jump past this number in the argument string */
+                    if ((char) tolower(number[0]) == 'x')
+                    {
+                        /* perform hex conversion */
+                        number[0] = '0';        /* replace the x with a zero */
+                        *pBuffer++ = (char) strtol(number, &pEnd, 16);
+                        if (pEnd != number + 3)
+                            Abort("command error, not a valid hexadecimal number : %s\n", &number[1]);
+                    }
+                    else                       /* decimal conversion */
+                    {
+                        *pBuffer++ = (char) strtol(number, &pEnd, 10);
+                        if (pEnd != number + 3)
+                            Abort("command error, not a valid decimal number : %s\n", number);
+                    }
+                }
+                else                          /* strlen(pArgStr) < 3 so abort */
+                    Abort("command error, a single colon must be followed by three decimal digits or an 'x' followed by 2 hexadecimal numbers\n");
+            }
+        }
+    }  /* while */
+    return pBuffer - pStart;               /* actual length of buffer */
+}
+
+
+unsigned char Text2Byte(const unsigned char *p)
+{
+    int x;
+    int y;
+    unsigned char b;
+
+    /* Convert textual representation to an int, trivial ;) */
+    x = toupper(p[0]) - '0';
+    x -= (x > 9) ? 7 : 0;
+
+    y = toupper(p[1]) - '0';
+    y -= (y > 9) ? 7 : 0;
+
+    b = ((x & 0xf) << 4) | (y & 0xf);
+
+    return b;
+}
+
+
+int ParseHexLine(const char *pIn, char *pOut)
+{
+    int i = 0;
+    int j = 0;
+
+    if (strlen(pIn) & 1)
+    {
+        Abort("command error, hex string cannot have an odd number of characters");
+    }
+
+    for (i = 0; pIn[i] != 0; i++)
+    {
+        if (!isxdigit((int) pIn[i]))
+        {
+            Abort("command error, not a valid hexadecimal digit : %c", pIn[i]);
+        }
+
+        pOut[j] = (char) Text2Byte((const unsigned char *) &pIn[i]);
+        i++;
+        j++;
+    }
+
+    return j;
+}
+
+
+void DoExpansion(char *pBuf, int Len)
+{
+    int i;
+    int j;
+    char *pTmp;
+
+    if ((pTmp = (char *) malloc((size_t) Len)) == NULL)
+        Abort("error, unable to allocate expansion buffer");
+
+    memcpy(pTmp, pBuf, Len);
+
+    for (i = 0, j = 0; i < Len; i++)
+    {
+        pBuf[j++] = pTmp[i];
+        pBuf[j++] = 0;
+    }
+
+    free(pTmp);
+}
+
+/* Input  : pArgStr - raw search or replace string
+ *          ppBuffer - receives a buffer allocated to fit, any previous
+ *                     buffer is released
+ * Returns: length of the parsed string
+ *
+ * Applies the escape syntax and the 'w' and 'X' modifiers. The parsed
+ * form never grows beyond the raw string except for the doubling done
+ * by 'w', so the buffer is sized from the raw length and patterns of
+ * any length are accepted.
+ */
+static unsigned int ParseStringArg(char *pArgStr, char **ppBuffer)
+{
+    unsigned int n;
+
+    free(*ppBuffer);
+    if ((*ppBuffer = (char *) malloc(2 * strlen(pArgStr) + 2)) == NULL)
+        Abort("error, unable to allocate pattern buffer");
+
+    if (fStringAsHex)
+        n = ParseHexLine(pArgStr, *ppBuffer);
+    else
+        n = GetPattern(pArgStr, *ppBuffer);
+
+    if (fWideString && n)
+    {
+        DoExpansion(*ppBuffer, n);
+        n *= 2;
+    }
+
+    return n;
+}
+
+
+/* Returns: pointer to a new zeroed entry appended to the rule table
+ */
+static GSAR_RULE *AddRule(void)
+{
+#if defined(__UNIX__)
+    /* SunOS doesn't allow realloc to be called with NULL :-( */
+    if (pRules == NULL)
+        pRules = (GSAR_RULE *) malloc((nRules + 1) * sizeof(GSAR_RULE));
+    else
+#endif
+        pRules = (GSAR_RULE *) realloc(pRules, (nRules + 1) * sizeof(GSAR_RULE));
+
+    if (pRules == NULL)
+        Abort("error, unable to allocate rule table");
+
+    memset(&pRules[nRules], 0, sizeof(GSAR_RULE));
+    return &pRules[nRules++];
+}
+
+
+/* Keep the legacy single pattern globals in step with the first rule
+ * so all single pattern code paths are untouched. The globals alias
+ * the rule's buffers, which never move once parsed; only the rule
+ * table itself is relocated by realloc.
+ */
+static void MirrorFirstRule(void)
+{
+    nItemsSearch = pRules[0].nSearch;
+    SearchBuf = pRules[0].Search;
+
+    if (pRules[0].fReplace)
+    {
+        nItemsReplace = pRules[0].nReplace;
+        if (pRules[0].Replace != NULL)
+            ReplaceBuf = pRules[0].Replace;
+    }
+}
+
+
+/* Input  : pFileName - name of the rules file
+ * Returns: nothing
+ *
+ * Reads search & replace pairs from a file, one rule per line with the
+ * search and replace strings separated by a single TAB. The escape
+ * syntax and the 'w' and 'X' modifiers apply as on the command line.
+ * A line without a TAB is a plain search pattern; empty lines and
+ * lines starting with '#' are skipped.
+ */
+static void ReadRulesFile(char *pFileName)
+{
+    FILE *fp;
+    char *pLine;
+    size_t LineCap = 512;
+    size_t Len;
+    char *pSep;
+    char *pEnd;
+    GSAR_RULE *pRule;
+
+    if ((fp = fopen(pFileName, "r")) == NULL)
+        Abort("error, unable to open rules file '%s'", pFileName);
+
+    if ((pLine = (char *) malloc(LineCap)) == NULL)
+        Abort("error, unable to allocate line buffer");
+
+    while (fgets(pLine, (int) LineCap, fp) != NULL)
+    {
+        /* grow the buffer until the whole line is in */
+        while ((Len = strlen(pLine)) == LineCap - 1 && pLine[Len - 1] != '\n')
+        {
+            LineCap *= 2;
+            if ((pLine = (char *) realloc(pLine, LineCap)) == NULL)
+                Abort("error, unable to allocate line buffer");
+            if (fgets(pLine + Len, (int) (LineCap - Len), fp) == NULL)
+                break;
+        }
+
+        pEnd = pLine + strlen(pLine);
+        while (pEnd > pLine && (*(pEnd - 1) == '\n' || *(pEnd - 1) == '\r'))
+            *--pEnd = '\0';
+
+        if (pLine[0] == '\0' || pLine[0] == '#')
+            continue;
+
+        pSep = strchr(pLine, '\t');
+        if (pSep != NULL)
+            *pSep++ = '\0';
+
+        pRule = AddRule();
+        pRule->nSearch = ParseStringArg(pLine, &pRule->Search);
+        if (pRule->nSearch == 0)
+            Abort("error, empty search pattern in rules file '%s'", pFileName);
+
+        if (pSep != NULL)
+        {
+            pRule->fReplace = 1;
+            pRule->nReplace = ParseStringArg(pSep, &pRule->Replace);
+            fSearchReplace = 1;
+        }
+    }
+
+    free(pLine);
+    fclose(fp);
+    MirrorFirstRule();
+}
+
+
+/* Input  : argc - number of arguments on the command line
+ *          argv - pointer to the argument vevtor
+ * Returns: number of actual filenames found
+ *
+ * Parses the command line & returns number of filenames found
+ */
+int GetArgs(int argc, char *argv[])
+{
+    int   i = 0;
+    int   j = 0;          /* counters */
+    int   c;              /* switch char */
+    char *pEnd;           /* the result of the string to long conversion */
+    long  longVal;
+    GSAR_RULE *pRule;     /* rule being filled in */
+    const char OptStr[] = "|s::r::iBfoc::x::T::P::blhd::u::FGwXMISACqztDj:p:m:R:g:n:@:k:O:";
+
+
+    pFileList = NULL;
+
+    if (argc > 1)
+    {
+        int Done = 0;
+
+        /* Prescan the argument list to detect search and replace modifiers, it needs
+         * the same list as the main parser since BAD_CHAR would be returned if not
+         */
+        while ((c = GetOpt(argc, argv, OptStr)) != EOF && !Done)
+        {
+            switch (c)
+            {
+                case 'w':
+                    fWideString = 1;
+                    break;
+                case 'X':
+                    fStringAsHex = 1;
+                    break;
+                case BAD_CHAR:
+                case MISSING_ARG:
+                case MISSING_OPT:
+                    Done = 1;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        /* Reset scanner */
+        GetOpt(argc, argv, NULL);
+
+        while ((c = GetOpt(argc, argv, OptStr)) != EOF)
+        {
+            switch (c)
+            {
+                case '|':
+                    /* create a vector of file pointers */
+#if defined(__UNIX__)
+                    /* SunOS doesn't allow realloc to be called with NULL :-(
+                     * Insert extra test on unix systems...
+                     */
+                    if (pFileList == NULL)
+                        pFileList = (char **) malloc((j + 2) * sizeof(char *));
+                    else
+#endif
+                        pFileList = (char **) realloc(pFileList, (j + 2) * sizeof(char *));
+                    pFileList[j++] = pOptArg;
+                    pFileList[j] = NULL;   /* The C-standard specifies that argv[argc] == NULL */
+                    break;
+                case MISSING_ARG:
+                    Abort("command error, the '%c' option requires an argument", (unsigned char) CurOpt);
+                    break;
+                case BAD_CHAR:
+                    Abort("command error, unknown option '%c'. Type 'gsar' by itself for help", (unsigned char) CurOpt);
+                    break;
+                case MISSING_OPT:
+                    i = 0;
+                    while (Usage[i] != NULL)
+                    {
+                        fputs(Usage[i++], Ctrl.fpMsg);
+                        fputc('\n', Ctrl.fpMsg);
+                    }
+                    exit(EXIT_SUCCESS);
+                    break;
+                case 's':
+                    if (pOptArg == NULL)
+                        Abort("command error, the '%c' option requires an argument", (unsigned char) CurOpt);
+
+                    /* a -r given before its -s leaves a rule with an empty
+                     * search pattern behind; fill that one, otherwise each
+                     * -s starts a new rule
+                     */
+                    if (nRules > 0 && pRules[nRules - 1].nSearch == 0)
+                        pRule = &pRules[nRules - 1];
+                    else
+                        pRule = AddRule();
+
+                    pRule->nSearch = ParseStringArg(pOptArg, &pRule->Search);
+                    MirrorFirstRule();
+                    break;
+                case 'r':
+                    if (nRules == 0 || pRules[nRules - 1].fReplace)
+                        pRule = AddRule();       /* -r given before its -s */
+                    else
+                        pRule = &pRules[nRules - 1];
+
+                    pRule->fReplace = 1;
+                    if (pOptArg == NULL)
+                        pRule->nReplace = 0;  /* we are to remove occurrence of -s */
+                    else
+                        pRule->nReplace = ParseStringArg(pOptArg, &pRule->Replace);
+
+                    MirrorFirstRule();
+                    fSearchReplace = 1;    /* only search & replace if -r option */
+                    break;
+                case 'p':
+                    ReadRulesFile(pOptArg);
+                    break;
+                case 'm':
+                    longVal = strtol(pOptArg, &pEnd, 0);
+
+                    switch (tolower((int) *pEnd))
+                    {
+                        case 'g':
+                            longVal *= 1024;
+                            /* fall through */
+                        case 'm':
+                            longVal *= 1024;
+                            /* fall through */
+                        case 'k':
+                            longVal *= 1024;
+                            pEnd++;
+                            break;
+                        default:
+                            break;
+                    }
+
+                    if (pEnd == pOptArg || *pEnd != '\0')
+                        Abort("command error, invalid buffer size : %s", pOptArg);
+
+                    if (longVal < 4096 || longVal > 0x40000000L)
+                        Abort("command error, buffer size must be in the range 4096 to 1g");
+
+                    BMG_SetBufSiz(longVal);
+                    break;
+                case 'u':                  /* replace LF with CR LF */
+                    if (pOptArg == NULL)
+                        pOptArg = "";
+                    if (!(*pOptArg == 'd' && *(pOptArg + 1) == '\0'))
+                        Abort("command error, unknown option 'u%s'. Type 'gsar' by itself for help", pOptArg);
+                    fSearchReplace = 1;
+                    nItemsSearch = 1;
+                    SearchBuf[0] = LF;
+                    nItemsReplace = 2;
+                    ReplaceBuf[0] = CR;
+                    ReplaceBuf[1] = LF;
+                    break;
+                case 'd':                  /* replace CR LF with LF */
+                    if (pOptArg == NULL)
+                        pOptArg = "";
+                    if (!(*pOptArg == 'u' && *(pOptArg + 1) == '\0'))
+                        Abort("command error, unknown option 'd%s'. Type 'gsar' by itself for help", pOptArg);
+                    fSearchReplace = 1;
+                    nItemsSearch = 2;
+                    SearchBuf[0] = CR;
+                    SearchBuf[1] = LF;
+                    nItemsReplace = 1;
+                    ReplaceBuf[0] = LF;
+                    break;
+                case 'i':
+                    fFolded = 1;
+                    break;
+                case 'G':
+                    ShowLicence();
+                    exit(EXIT_SUCCESS);
+                    break;
+                case 'l':
+                    Ctrl.fTextual = 0;      /* return to terse display */
+                    Ctrl.fHex = 0;
+                    Ctrl.fByteOffset = 0;
+                    break;
+                case 'o':
+                    fOverWrite = 1;
+                    break;
+                case 'f':
+                    fForce = 1;
+                    break;
+                case 'F':
+                    fFilter = 1;
+                    break;
+                case 'M':
+#ifdef __UNIX__
+                    fUseMmap = 1;
+#else
+                    Abort("command error, the 'M' option is only supported on Unix");
+#endif
+                    break;
+                case 'j':
+#ifdef __UNIX__
+                    longVal = strtol(pOptArg, &pEnd, 0);
+                    if (*pEnd != '\0')
+                        Abort("command error, invalid number : %s", pOptArg);
+
+                    if (longVal < 1 || longVal > 256)
+                        Abort("command error, number of workers must be in the range 1 to 256");
+
+                    nWorkers = (int) longVal;
+#else
+                    Abort("command error, the 'j' option is only supported on Unix");
+#endif
+                    break;
+                case 'R':
+#ifdef __UNIX__
+                    pRecurseDirs = (char **) realloc(pRecurseDirs, (nRecurseDirs + 1) * sizeof(char *));
+                    if (pRecurseDirs == NULL)
+                        Abort("error, unable to allocate directory list");
+                    pRecurseDirs[nRecurseDirs++] = pOptArg;
+#else
+                    Abort("command error, the 'R' option is only supported on Unix");
+#endif
+                    break;
+                case 'g':
+#ifdef __UNIX__
+                    pNameGlobs = (char **) realloc(pNameGlobs, (nNameGlobs + 1) * sizeof(char *));
+                    if (pNameGlobs == NULL)
+                        Abort("error, unable to allocate glob list");
+                    pNameGlobs[nNameGlobs++] = pOptArg;
+#else
+                    Abort("command error, the 'g' option is only supported on Unix");
+#endif
+                    break;
+                case 'B':
+                    fBuffers = 1;
+                    break;
+                case 'I':
+                    fInPlace = 1;
+                    break;
+                case 'S':
+                    BMG_fStats = 1;
+                    break;
+                case '@':
+                    pFileListName = pOptArg;
+                    break;
+                case 'k':
+                    pCacheName = pOptArg;
+                    break;
+                case 'O':
+#ifdef __UNIX__
+                    pRecName = pOptArg;
+#else
+                    Abort("command error, the 'O' option is only supported on Unix");
+#endif
+                    break;
+                case 'q':
+                    fQuiet = 1;
+                    break;
+                case 'z':
+                    Ctrl.fRecords = 1;
+                    break;
+                case 't':
+                    fTextOnly = 1;
+                    break;
+                case 'D':
+                    fServe = 1;
+                    break;
+                case 'n':
+                    longVal = strtol(pOptArg, &pEnd, 0);
+                    if (*pEnd != '\0' || longVal < 1)
+                        Abort("command error, invalid match limit : %s", pOptArg);
+                    BMG_MatchLimit = longVal;
+                    break;
+                case 'A':
+#ifdef __UNIX__
+                    fAsyncRead = 1;
+#else
+                    Abort("command error, the 'A' option is only supported on Unix");
+#endif
+                    break;
+                case 'C':
+#ifdef __UNIX__
+                    fNoCache = 1;
+#else
+                    Abort("command error, the 'C' option is only supported on Unix");
+#endif
+                    break;
+                case 'T':
+                    fSummary = 1;
+                    if (pOptArg != NULL)
+                    {
+                        longVal = strtol(pOptArg, &pEnd, 0);
+                        if (*pEnd != '\0' || longVal < 1)
+                            Abort("command error, invalid ranking size : %s", pOptArg);
+                        nTopRank = (int) longVal;
+                    }
+                    break;
+                case 'P':
+                    fProgress = 1;
+                    if (pOptArg != NULL)
+                    {
+                        longVal = strtol(pOptArg, &pEnd, 0);
+                        if (*pEnd != '\0' || longVal < 1)
+                            Abort("command error, invalid progress interval : %s", pOptArg);
+                        nProgSecs = (int) longVal;
+                    }
+                    break;
+                case 'b':
+                    Ctrl.fByteOffset = 1;    /* display file offset */
+                    break;
+                case 'h':
+                    Ctrl.fFileSpec = 0;      /* turn off filespec */
+                    break;
+                case 'x':
+                    Ctrl.fTextual = -1;      /* signal fall through */
+                    Ctrl.fHex = 1;           /* display context in hex */
+                case 'c':
+                    if (Ctrl.fTextual == -1)  /* entered through case 'x' */
+                        Ctrl.fTextual = 0;        /* reset sentinel value  */
+                    else
+                    {
+                        Ctrl.fHex = 0;        /* entered through case 'c' */
+                        Ctrl.fTextual = 1;    /* display textual context */
+                    }
+
+                    if (pOptArg == NULL)
+                        Ctrl.Context = (Ctrl.fHex == 1) ? HEX_CONTEXT : TXT_CONTEXT;
+                    else
+                    {
+                        longVal = strtol(pOptArg, &pEnd, 0);
+                        if (*pEnd != '\0')
+                            Abort("command error, invalid number : %s", pOptArg);
+
+                        if (longVal < 16)
+                            Abort("command error, context size must be at least 16");
+
+                        if (longVal > USHRT_MAX)
+                            Ctrl.Context = USHRT_MAX;
+                        else
+                            Ctrl.Context = (unsigned int) longVal;
+                    }
+                    break;
+                case 'w':
+                case 'X':
+                    /* we have to catch these as well but do nothing */
+                    break;
+                default:
+                    Abort("internal error, option '%c' not handled in switch", (unsigned char) CurOpt);
+                    break;
+            }
+        }
+    }
+    else
+    {
+        i = 0;
+        while (Usage[i] != NULL)
+        {
+            fputs(Usage[i++], Ctrl.fpMsg);
+            fputc('\n', Ctrl.fpMsg);
+        }
+        exit(EXIT_SUCCESS);
+    }
+
+    Ctrl.fVerbose = (Ctrl.fTextual ||
+                     Ctrl.fHex ||
+                     Ctrl.fByteOffset ||
+                     Ctrl.fRecords) ? 1 : 0;
+
+    return j;
+}
+
+
+
+#ifdef __linux__
+/* Input  : fd - descriptor that may be a pipe end
+ *
+ * Grows the pipe behind 'fd' to hold a full search buffer. A default
+ * Linux pipe holds 64 Kb, so a filter stage otherwise pays sixteen
+ * syscalls and wakeups per megabyte moved on each side. Moving the
+ * clean stretches kernel side with splice() is not an option: every
+ * byte has to reach the search buffer to be verified anyway, and
+ * handing our recycled buffer pages to the pipe with vmsplice() would
+ * corrupt data still in flight once the buffer is refilled. Failure
+ * is ignored; the kernel caps pipe growth for unprivileged users
+ * through fs/pipe-max-size.
+ */
+static void GrowPipe(int fd)
+{
+    struct stat StatBuf;
+
+    if (fstat(fd, &StatBuf) == 0 && S_ISFIFO(StatBuf.st_mode))
+        fcntl(fd, F_SETPIPE_SZ, (int) BMG_BufSiz);
+}
+#endif
+
+/* Perform search or replace using stdin and stdout ie as a 'filter'
+ * When gsar operates as a filter all output ie context, byte filenames
+ * etc are all sent to stderr.
+ */
+void StreamSearchReplace(void)
+{
+    long  nMatches;
+
+    Ctrl.pInputFile = "stdin";      /* proper filename   */
+    Ctrl.fpMsg = stderr;            /* redirect messages */
+
+#ifdef MSDOS
+    /* when MSDOS operates on streams it translates characters and terminates
+     * input and output when it encounters a CTRL Z. The code below makes
+     * MSDOS treat the streams as binary. Stdin cannot be used since MSDOS
+     * ignores the CTRL-Z. If you pipe a binary stream to MSDOS under some
+     * compilers you might get a write error (BCC, Zortech)
+     */
+    if (isatty(fileno(stdin)))
+        Abort("error, input from tty is not supported under MSDOS");
+    setmode(fileno(stdin), O_BINARY);
+    setmode(fileno(stdout), O_BINARY);
+#endif
+
+#ifdef __linux__
+    /* move a full search buffer per syscall when we are a pipeline stage */
+    GrowPipe(fileno(stdin));
+    GrowPipe(fileno(stdout));
+#endif
+
+    Ctrl.fpIn = stdin;              /* input from stdin  */
+    Ctrl.fpOut = stdout;            /* output to stdout  */
+
+    if (!fSearchReplace)
+    {
+        nMatches = (nRules > 1) ? BMG_MultiSearch(&Ctrl) : BMG_Search(&Ctrl);
+
+        if (nMatches > 0)
+        {
+            fFoundMatch = 1;
+            if (!fQuiet && !Ctrl.fRecords)
+                fprintf(Ctrl.fpMsg, "%s: %ld match%s found\n",
+                        Ctrl.pInputFile, nMatches, (nMatches == 1) ? "" : "es");
+        }
+    }
+    else
+    {
+        nMatches = (nRules > 1) ? BMG_MultiSearchReplace(&Ctrl)
+                                : BMG_SearchReplace(&Ctrl, ReplaceBuf, nItemsReplace);
+
+        if (nMatches == -1)   /* error in writing file */
+            Abort("error in writing file to stdout\n");
+        else if (nMatches > 1)
+        {
+            fflush(Ctrl.fpOut);
+            fprintf(Ctrl.fpMsg, "%s: %ld occurrence%s changed\n",
+                    Ctrl.pInputFile, nMatches, (nMatches > 1) ? "s" : "");
+        }
+    }
+
+    if (BMG_fStats)
+    {
+        BMG_StatsReport(&Ctrl, &BMG_Stats, Ctrl.pInputFile);
+        BMG_StatsFold();
+    }
+}
+
+/* One file in the match count ranking of the aggregate summary
+ */
+typedef struct
+{
+    char *pName;     /* file with at least one match */
+    long  nMatches;  /* matches found in it */
+} RANK_ENTRY;
+
+/* Aggregate counters for the end of run summary, accumulated while
+ * the files are processed so the report costs nothing to produce
+ */
+static long SumFiles = 0;               /* files scanned */
+static long SumMatched = 0;             /* files with at least one match */
+static long SumSkipped = 0;             /* files that could not be processed */
+static long long SumMatches = 0;        /* total matches */
+static unsigned long long SumBytes = 0; /* bytes taken on */
+static double SumStart = 0.0;           /* start of the run */
+
+static RANK_ENTRY *pRank = NULL;        /* growable table of matched files */
+static long nRank = 0;                  /* entries in the table */
+static long RankCap = 0;                /* size of the table */
+
+#ifdef __UNIX__
+static pthread_mutex_t SumLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Returns the current time in seconds. Resolution well below a
+ * millisecond is needed for the rate to mean anything on short runs.
+ */
+static double SumTime(void)
+{
+#ifdef __UNIX__
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#else
+    return (double) clock() / (double) CLOCKS_PER_SEC;
+#endif
+}
+
+/* Progress reporting for the 'P' option: one machine readable line on
+ * stderr at a fixed interval, files completed, bytes processed and the
+ * current rate. The engines feed ProgAdd once per buffer refill and
+ * the clock is only consulted there, never in the scan loops, so a
+ * reported run is as fast as a silent one.
+ */
+static long ProgFiles = 0;               /* files completed so far */
+static unsigned long long ProgBytes = 0; /* bytes handed to the engines */
+static unsigned long long ProgMark = 0;  /* bytes at the previous line */
+static double ProgLast = 0.0;            /* time of the previous line */
+static double ProgNext = 0.0;            /* when the next line is due */
+
+#ifdef __UNIX__
+static pthread_mutex_t ProgLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Input  : nBytes - bytes just read by one of the search engines
+ *
+ * Accumulates and, when the interval is up, prints the progress line.
+ * Installed as BMG_pfProgress and also called directly by the mapped
+ * and sparse paths, which read no buffers; hence the flag test.
+ */
+static void ProgAdd(unsigned long long nBytes)
+{
+    double Now;
+    double Mb;
+
+    if (!fProgress)
+        return;
+
+#ifdef __UNIX__
+    pthread_mutex_lock(&ProgLock);
+#endif
+
+    ProgBytes += nBytes;
+
+    Now = SumTime();
+    if (Now >= ProgNext)
+    {
+        Mb = (double) (ProgBytes - ProgMark) / (1024.0 * 1024.0);
+        fprintf(stderr, "gsar: progress files %ld bytes %llu rate %.1f Mb/s\n",
+                ProgFiles, ProgBytes,
+                (Now > ProgLast) ? Mb / (Now - ProgLast) : 0.0);
+
+        ProgMark = ProgBytes;
+        ProgLast = Now;
+        ProgNext = Now + (double) nProgSecs;
+    }
+
+#ifdef __UNIX__
+    pthread_mutex_unlock(&ProgLock);
+#endif
+}
+
+/* Counts one completed file towards the progress line
+ */
+static void ProgFile(void)
+{
+    if (!fProgress)
+        return;
+
+#ifdef __UNIX__
+    pthread_mutex_lock(&ProgLock);
+#endif
+    ProgFiles++;
+#ifdef __UNIX__
+    pthread_mutex_unlock(&ProgLock);
+#endif
+}
+
+/* Input  : pName - file that has just been processed
+ *          nMatches - matches found or changed in it
+ *
+ * Records one processed file in the aggregate counters and, when a
+ * ranking was asked for, in the ranking table. Called from the worker
+ * threads as well, hence the lock.
+ */
+static void SumFile(char *pName, long nMatches)
+{
+    struct stat StatBuf;
+
+    ProgFile();      /* every finished file advances the progress count */
+
+    if (!fSummary)
+        return;
+
+#ifdef __UNIX__
+    pthread_mutex_lock(&SumLock);
+#endif
+
+    SumFiles++;
+    if (stat(pName, &StatBuf) == 0)
+        SumBytes += (unsigned long long) StatBuf.st_size;
+
+    if (nMatches > 0)
+    {
+        SumMatched++;
+        SumMatches += nMatches;
+
+        if (nTopRank > 0)
+        {
+            if (nRank == RankCap)
+            {
+                RankCap = (RankCap == 0) ? 64 : RankCap * 2;
+                if ((pRank = (RANK_ENTRY *) realloc(pRank, (size_t) RankCap * sizeof(RANK_ENTRY))) == NULL)
+                    Abort("error, unable to grow the ranking table");
+            }
+
+            if ((pRank[nRank].pName = DupStr(pName)) == NULL)
+                Abort("error, unable to allocate a file name");
+            pRank[nRank].nMatches = nMatches;
+            nRank++;
+        }
+    }
+
+#ifdef __UNIX__
+    pthread_mutex_unlock(&SumLock);
+#endif
+}
+
+/* Records a file that could not be opened or was not a regular file
+ */
+static void SumSkip(void)
+{
+    if (!fSummary)
+        return;
+
+#ifdef __UNIX__
+    pthread_mutex_lock(&SumLock);
+#endif
+    SumSkipped++;
+#ifdef __UNIX__
+    pthread_mutex_unlock(&SumLock);
+#endif
+}
+
+/* Ranking order: most matches first, ties in name order so the
+ * report is stable between runs
+ */
+static int RankCmp(const void *p1, const void *p2)
+{
+    const RANK_ENTRY *pA = (const RANK_ENTRY *) p1;
+    const RANK_ENTRY *pB = (const RANK_ENTRY *) p2;
+
+    if (pA->nMatches != pB->nMatches)
+        return (pB->nMatches > pA->nMatches) ? 1 : -1;
+    return strcmp(pA->pName, pB->pName);
+}
+
+/* Prints the aggregate summary and the optional match count ranking.
+ * Called once at the end of the run, after the last file is done.
+ */
+static void SumReport(void)
+{
+    double Elapsed;
+    double Mb;
+    long i, n;
+
+    if (!fSummary)
+        return;
+
+    Elapsed = SumTime() - SumStart;
+    Mb = (double) SumBytes / (1024.0 * 1024.0);
+
+    fprintf(Ctrl.fpMsg, "gsar: %ld file%s scanned, %ld with matches, %ld skipped\n",
+            SumFiles, (SumFiles == 1) ? "" : "s", SumMatched, SumSkipped);
+    fprintf(Ctrl.fpMsg, "gsar: %lld match%s, %.1f Mb in %.2f s (%.1f Mb/s)\n",
+            SumMatches, (SumMatches == 1) ? "" : "es",
+            Mb, Elapsed, (Elapsed > 0.0) ? Mb / Elapsed : 0.0);
+
+    if (nTopRank > 0 && nRank > 0)
+    {
+        qsort(pRank, (size_t) nRank, sizeof(RANK_ENTRY), RankCmp);
+
+        n = (nRank < (long) nTopRank) ? nRank : (long) nTopRank;
+        fprintf(Ctrl.fpMsg, "gsar: top %ld file%s by match count:\n",
+                n, (n == 1) ? "" : "s");
+        for (i = 0; i < n; i++)
+            fprintf(Ctrl.fpMsg, "%8ld  %s\n", pRank[i].nMatches, pRank[i].pName);
+    }
+}
+
+/* One file in the scan cache of the 'k' option
+ */
+typedef struct
+{
+    char *pName;              /* file the entry belongs to */
+    unsigned long long Size;  /* its size when it was scanned */
+    long long MTime;          /* its mtime when it was scanned */
+    long nMatches;            /* matches found back then */
+    signed char fSeen;        /* file was visited this run */
+} CACHE_ENTRY;
+
+static CACHE_ENTRY *pCache = NULL;    /* entries loaded from the cache file */
+static long nCache = 0;               /* number of loaded entries */
+static CACHE_ENTRY *pCacheNew = NULL; /* entries for files scanned this run */
+static long nCacheNew = 0;            /* number of new entries */
+static long CacheNewCap = 0;          /* size of the new entry table */
+static unsigned long long CachePatHash = 0;  /* hash of the pattern set */
+
+#ifdef __UNIX__
+static pthread_mutex_t CacheLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Input  : h - running hash value
+ *          pData - bytes to fold in
+ *          nData - number of bytes
+ * Returns: the updated hash (FNV-1a)
+ */
+static unsigned long long HashFold(unsigned long long h, const char *pData, unsigned int nData)
+{
+    unsigned int i;
+
+    for (i = 0; i < nData; i++)
+    {
+        h ^= (unsigned char) pData[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* Returns a hash over the search pattern set and the fold flag. A
+ * cache written under a different pattern set must not be believed,
+ * so the hash goes into the cache file header.
+ */
+static unsigned long long CachePatternHash(void)
+{
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    unsigned int r;
+
+    h = HashFold(h, (char *) &fFolded, sizeof(fFolded));
+
+    if (nRules > 1)
+        for (r = 0; r < nRules; r++)
+        {
+            h = HashFold(h, (char *) &pRules[r].nSearch, sizeof(pRules[r].nSearch));
+            h = HashFold(h, pRules[r].Search, pRules[r].nSearch);
+        }
+    else
+    {
+        h = HashFold(h, (char *) &nItemsSearch, sizeof(nItemsSearch));
+        h = HashFold(h, SearchBuf, nItemsSearch);
+    }
+
+    return h;
+}
+
+/* Name order for the loaded entries, so a probe is a binary search
+ */
+static int CacheCmp(const void *p1, const void *p2)
+{
+    return strcmp(((const CACHE_ENTRY *) p1)->pName,
+                  ((const CACHE_ENTRY *) p2)->pName);
+}
+
+/* Reads the cache file into memory. A missing file is simply a first
+ * run, and a header written under a different pattern set discards
+ * the whole cache - it will be rebuilt by this run.
+ */
+static void CacheLoad(void)
+{
+    FILE *fp;
+    char  Line[FILENAME_MAX + 80];
+    unsigned long long Hash;
+    long  Cap = 0;
+    int   Ofs;
+    char *pEnd;
+
+    if (pCacheName == NULL)
+        return;
+
+    if ((fp = fopen(pCacheName, "r")) == NULL)
+        return;
+
+    if (fgets(Line, sizeof(Line), fp) == NULL ||
+        sscanf(Line, "gsar cache 1 %llx", &Hash) != 1 || Hash != CachePatHash)
+    {
+        fclose(fp);
+        return;
+    }
+
+    while (fgets(Line, sizeof(Line), fp) != NULL)
+    {
+        CACHE_ENTRY Entry;
+
+        if (sscanf(Line, "%llu %lld %ld %n", &Entry.Size, &Entry.MTime,
+                   &Entry.nMatches, &Ofs) != 3)
+            continue;
+
+        pEnd = Line + strlen(Line);
+        while (pEnd > Line && (pEnd[-1] == '\n' || pEnd[-1] == '\r'))
+            *--pEnd = '\0';
+
+        if (Line[Ofs] == '\0')
+            continue;
+
+        if (nCache == Cap)
+        {
+            Cap = (Cap == 0) ? 256 : Cap * 2;
+            if ((pCache = (CACHE_ENTRY *) realloc(pCache, (size_t) Cap * sizeof(CACHE_ENTRY))) == NULL)
+                Abort("error, unable to grow the scan cache");
+        }
+
+        if ((Entry.pName = DupStr(&Line[Ofs])) == NULL)
+            Abort("error, unable to allocate a file name");
+        Entry.fSeen = 0;
+        pCache[nCache++] = Entry;
+    }
+
+    fclose(fp);
+    qsort(pCache, (size_t) nCache, sizeof(CACHE_ENTRY), CacheCmp);
+}
+
+/* Input  : pCtrl - context naming the input file
+ *          pnMatches - receives the cached match count on a hit
+ * Returns: 1 - the file is unchanged, the result came from the cache
+ *          0 - no usable entry, the file has to be scanned
+ */
+static int CacheProbe(OUTPUT_CTRL *pCtrl, long *pnMatches)
+{
+    struct stat StatBuf;
+    CACHE_ENTRY Key;
+    CACHE_ENTRY *pEntry;
+    int fHit = 0;
+
+    if (pCacheName == NULL || nCache == 0)
+        return 0;
+
+    if (stat(pCtrl->pInputFile, &StatBuf) != 0)
+        return 0;
+
+    Key.pName = pCtrl->pInputFile;
+
+#ifdef __UNIX__
+    pthread_mutex_lock(&CacheLock);
+#endif
+
+    pEntry = (CACHE_ENTRY *) bsearch(&Key, pCache, (size_t) nCache,
+                                     sizeof(CACHE_ENTRY), CacheCmp);
+    if (pEntry != NULL &&
+        pEntry->Size == (unsigned long long) StatBuf.st_size &&
+        pEntry->MTime == (long long) StatBuf.st_mtime)
+    {
+        pEntry->fSeen = 1;
+        *pnMatches = pEntry->nMatches;
+        fHit = 1;
+    }
+
+#ifdef __UNIX__
+    pthread_mutex_unlock(&CacheLock);
+#endif
+    return fHit;
+}
+
+/* Input  : pName - file that has just been scanned
+ *          nMatches - matches found in it
+ *
+ * Records the scan result for the next run. The file is stat'ed after
+ * the scan, so a file modified while it was being read gets a fresh
+ * mtime and falls out of the cache again.
+ */
+static void CacheStore(char *pName, long nMatches)
+{
+    struct stat StatBuf;
+    CACHE_ENTRY *pEntry;
+
+    if (pCacheName == NULL)
+        return;
+
+    if (stat(pName, &StatBuf) != 0)
+        return;
+
+#ifdef __UNIX__
+    pthread_mutex_lock(&CacheLock);
+#endif
+
+    if (nCacheNew == CacheNewCap)
+    {
+        CacheNewCap = (CacheNewCap == 0) ? 256 : CacheNewCap * 2;
+        if ((pCacheNew = (CACHE_ENTRY *) realloc(pCacheNew, (size_t) CacheNewCap * sizeof(CACHE_ENTRY))) == NULL)
+            Abort("error, unable to grow the scan cache");
+    }
+
+    pEntry = &pCacheNew[nCacheNew++];
+    if ((pEntry->pName = DupStr(pName)) == NULL)
+        Abort("error, unable to allocate a file name");
+    pEntry->Size = (unsigned long long) StatBuf.st_size;
+    pEntry->MTime = (long long) StatBuf.st_mtime;
+    pEntry->nMatches = nMatches;
+    pEntry->fSeen = 1;
+
+#ifdef __UNIX__
+    pthread_mutex_unlock(&CacheLock);
+#endif
+}
+
+/* Rewrites the cache file with the files visited this run: the
+ * unchanged ones keep their loaded entry, the scanned ones get a
+ * fresh one. Files that were not visited drop out, so the cache
+ * follows the scanned tree instead of growing forever.
+ */
+static void CacheSave(void)
+{
+    FILE *fp;
+    long  i;
+
+    if (pCacheName == NULL)
+        return;
+
+    if ((fp = fopen(pCacheName, "w")) == NULL)
+    {
+        fprintf(Ctrl.fpMsg, "gsar: warning, unable to write scan cache '%s'\n", pCacheName);
+        return;
+    }
+
+    fprintf(fp, "gsar cache 1 %llx\n", CachePatHash);
+
+    for (i = 0; i < nCache; i++)
+        if (pCache[i].fSeen)
+            fprintf(fp, "%llu %lld %ld %s\n", pCache[i].Size, pCache[i].MTime,
+                    pCache[i].nMatches, pCache[i].pName);
+
+    for (i = 0; i < nCacheNew; i++)
+        fprintf(fp, "%llu %lld %ld %s\n", pCacheNew[i].Size, pCacheNew[i].MTime,
+                pCacheNew[i].nMatches, pCacheNew[i].pName);
+
+    fclose(fp);
+}
+
+
+/* Binary match record sink behind the 'O' option. Matches append fixed
+ * size records, file id and byte offset, to an arena flushed in bulk,
+ * so a match dense scan pays a memcpy per match instead of a formatted
+ * print, and a downstream indexer reads the records back without
+ * parsing text. The file layout, all in native byte order:
+ *
+ *   "GSIX", u32 version, u64 record count, u64 name table offset and
+ *   u64 name count, then 16 byte records of u32 file id, u32 zero and
+ *   u64 byte offset. The name table, written last when the counts are
+ *   patched into the header, holds one entry per file id in order: a
+ *   u32 length followed by that many name bytes including the NUL.
+ */
+#define REC_VERSION 1
+
+static FILE *fpRec = NULL;              /* the open record file */
+static unsigned char *pRecBuf = NULL;   /* record arena */
+static long RecLen = 0;                 /* bytes staged in the arena */
+static long RecCap = 0;                 /* size of the arena */
+static unsigned long long nRecords = 0; /* records written plus staged */
+static char **pRecNames = NULL;         /* file id to file name */
+static unsigned int nRecNames = 0;      /* names in the table */
+static unsigned int RecNameCap = 0;     /* size of the table */
+
+#ifdef __UNIX__
+static pthread_mutex_t RecLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Writes the header with the counts known so far; called once with
+ * zeros to reserve the space and again at the end to patch it.
+ */
+static void RecHeader(unsigned long long NameOfs)
+{
+    unsigned int Version = REC_VERSION;
+    unsigned long long nNames = (unsigned long long) nRecNames;
+
+    if (fwrite("GSIX", 1, 4, fpRec) != 4 ||
+        fwrite(&Version, sizeof(Version), 1, fpRec) != 1 ||
+        fwrite(&nRecords, sizeof(nRecords), 1, fpRec) != 1 ||
+        fwrite(&NameOfs, sizeof(NameOfs), 1, fpRec) != 1 ||
+        fwrite(&nNames, sizeof(nNames), 1, fpRec) != 1)
+        Abort("error, unable to write record file '%s'", pRecName);
+}
+
+static void RecOpen(void)
+{
+    RecCap = BMG_BufSiz;
+    if ((pRecBuf = (unsigned char *) malloc((size_t) RecCap)) == NULL)
+        Abort("error, unable to allocate record buffer");
+
+    if ((fpRec = fopen(pRecName, "wb")) == NULL)
+        Abort("error, unable to create record file '%s'", pRecName);
+
+    RecHeader(0);
+}
+
+/* flushes the arena with one write; RecLock must be held */
+static void RecFlush(void)
+{
+    if (RecLen != 0 &&
+        fwrite(pRecBuf, 1, (size_t) RecLen, fpRec) != (size_t) RecLen)
+        Abort("error, unable to write record file '%s'", pRecName);
+    RecLen = 0;
+}
+
+/* Input  : pCtrl - context naming the current input file
+ *          Ofs - byte offset of the match
+ *
+ * Called by the engine through the pfEmitRec hook in place of the
+ * formatted display. The file id of the current file is cached in the
+ * context so the name table is consulted once per file, not per match.
+ */
+static void RecEmit(OUTPUT_CTRL *pCtrl, unsigned long long Ofs)
+{
+    unsigned int Id;
+    unsigned int Zero = 0;
+
+#ifdef __UNIX__
+    pthread_mutex_lock(&RecLock);
+#endif
+
+    if (pCtrl->pRecFile != pCtrl->pInputFile)
+    {
+        /* mapped chunk workers share one file, so look before adding */
+        for (Id = 0; Id < nRecNames; Id++)
+            if (pRecNames[Id] == pCtrl->pInputFile)
+                break;
+
+        if (Id == nRecNames)
+        {
+            if (nRecNames == RecNameCap)
+            {
+                RecNameCap = (RecNameCap == 0) ? 256 : RecNameCap * 2;
+                pRecNames = (char **) realloc(pRecNames, RecNameCap * sizeof(char *));
+                if (pRecNames == NULL)
+                    Abort("error, unable to grow record name table");
+            }
+            pRecNames[nRecNames++] = pCtrl->pInputFile;
+        }
+
+        pCtrl->pRecFile = pCtrl->pInputFile;
+        pCtrl->RecId = (int) Id;
+    }
+
+    if (RecLen + 16 > RecCap)
+        RecFlush();
+
+    Id = (unsigned int) pCtrl->RecId;
+    memcpy(pRecBuf + RecLen, &Id, sizeof(Id));
+    memcpy(pRecBuf + RecLen + 4, &Zero, sizeof(Zero));
+    memcpy(pRecBuf + RecLen + 8, &Ofs, sizeof(Ofs));
+    RecLen += 16;
+    nRecords++;
+
+#ifdef __UNIX__
+    pthread_mutex_unlock(&RecLock);
+#endif
+}
+
+/* flushes the records, appends the name table and patches the header */
+static void RecClose(void)
+{
+    unsigned long long NameOfs;
+    unsigned int i;
+    unsigned int Len;
+
+    if (fpRec == NULL)
+        return;
+
+    RecFlush();
+
+    NameOfs = (unsigned long long) ftell(fpRec);
+
+    for (i = 0; i < nRecNames; i++)
+    {
+        Len = (unsigned int) strlen(pRecNames[i]) + 1;
+        if (fwrite(&Len, sizeof(Len), 1, fpRec) != 1 ||
+            fwrite(pRecNames[i], 1, Len, fpRec) != Len)
+            Abort("error, unable to write record file '%s'", pRecName);
+    }
+
+    if (fseek(fpRec, 0L, SEEK_SET) != 0)
+        Abort("error, unable to write record file '%s'", pRecName);
+    RecHeader(NameOfs);
+
+    if (fclose(fpRec) != 0)
+        Abort("error, unable to write record file '%s'", pRecName);
+    fpRec = NULL;
+}
+
+
+/* Input  : pCtrl - context whose message stream receives eventual errors
+ *          filename
+ * Returns: 1 - file is OK, i.e we get a stat on it and it's a regular file
+ *          0 - file is NOK
+ *
+ * Eventual errors are displayed here
+ */
+char fCheckFile(OUTPUT_CTRL *pCtrl, char *pFileName)
+{
+    struct stat buf;
+
+    if (stat(pFileName, &buf) != 0)
+    {
+        fprintf(pCtrl->fpMsg, "gsar: unable to open input file '%s'\n", pFileName);
+        SumSkip();
+        return 0;
+    }
+
+
+    /* If it's not a regular file */
+    if (!S_ISREG(buf.st_mode))
+    {
+        /* If it's NOT a dircetory flag warning */
+        if (!S_ISDIR(buf.st_mode))
+        {
+            fprintf(pCtrl->fpMsg, "gsar: warning, not a regular file '%s'\n", pFileName);
+        }
+        SumSkip();
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Input  : pCtrl - context naming the input file
+ * Returns: 1 if the first block of the file looks binary
+ *
+ * A file whose first block contains a zero byte is taken to be
+ * binary, the same heuristic grep uses. Skipped files cost one block
+ * of read; text files cost one extra open, which the file cache makes
+ * cheap.
+ */
+static int BinaryFile(OUTPUT_CTRL *pCtrl)
+{
+    unsigned char Sample[8192];
+    FILE  *fp;
+    size_t n;
+
+    if ((fp = fopen(pCtrl->pInputFile, "rb")) == NULL)
+        return 0;     /* let the real open report the failure */
+
+    n = fread(Sample, 1, sizeof(Sample), fp);
+    fclose(fp);
+
+    return memchr(Sample, 0, n) != NULL;
+}
+
+#ifdef __UNIX__
+/* Input  : fp - freshly opened input stream
+ *
+ * Tells the kernel the file will be read once from front to back,
+ * which widens the readahead window on a cold scan. Failure is
+ * ignored; not every file system honours the hint.
+ */
+static void AdviseSequential(FILE *fp)
+{
+    posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+/* Input  : fp - input stream that has been scanned to the end
+ *
+ * Drops the scanned pages from the page cache when the 'C' option is
+ * given, so one pass batch scans do not evict the working set of the
+ * other tenants of the machine. Pages that were cached before the
+ * scan go too; the option is meant for data nobody is about to read
+ * again.
+ */
+static void DropCache(FILE *fp)
+{
+    if (fNoCache)
+        posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_DONTNEED);
+}
+
+/* One chunk of a parallel single file scan
+ */
+typedef struct
+{
+    OUTPUT_CTRL Ctx;           /* private context for captured output */
+    unsigned char *pData;      /* chunk start within the mapping */
+    unsigned long long nData;  /* chunk length including the overlap */
+    unsigned long long Base;   /* file offset of the chunk start */
+    char *pText;               /* match output captured by the worker */
+    size_t TextLen;            /* number of bytes captured */
+    long nMatches;             /* matches found in the chunk */
+    pthread_t Thread;
+} CHUNK;
+
+/* Scans one chunk into a memory stream so the match output can be
+ * emitted in file order once the chunks are joined.
+ */
+static void *ChunkWorker(void *pArg)
+{
+    CHUNK *pChunk = (CHUNK *) pArg;
+
+    if ((pChunk->Ctx.fpMsg = open_memstream(&pChunk->pText, &pChunk->TextLen)) == NULL)
+        Abort("internal error, unable to open a memory stream");
+
+    pChunk->nMatches = BMG_SearchMem(&pChunk->Ctx, pChunk->pData,
+                                     pChunk->nData, pChunk->Base);
+    ProgAdd(pChunk->nData);
+
+    fclose(pChunk->Ctx.fpMsg);
+    return NULL;
+}
+
+/* Input  : pCtrl - context of the serial driver
+ *          pMem - mapping of the whole input file
+ *          nLen - number of bytes in the mapping
+ * Returns: number of matches found in the mapping
+ *
+ * Splits the mapping into one chunk per worker thread, overlapping by
+ * the pattern length minus one - the same carryover the buffer refill
+ * uses. A match is always counted by the chunk its first byte falls
+ * in: the overlap lets a chunk complete a match that straddles its
+ * end, while a match starting inside the overlap would poke past the
+ * chunk and is left to the next one. The chunks are joined and their
+ * captured output emitted in file order, so the result is identical
+ * to a serial scan.
+ */
+static long ChunkedSearchMem(OUTPUT_CTRL *pCtrl, unsigned char *pMem, unsigned long long nLen)
+{
+    CHUNK *pChunks;
+    unsigned long long ChunkLen;
+    unsigned long long Tail;
+    long nMatches = 0;
+    int n, i;
+
+    /* chunks below a full search buffer are not worth a thread */
+    n = nWorkers;
+    while (n > 1 && nLen / (unsigned long long) n < (unsigned long long) BMG_BufSiz)
+        n--;
+
+    if (n == 1)
+    {
+        nMatches = BMG_SearchMem(pCtrl, pMem, nLen, 0);
+        ProgAdd(nLen);
+        return nMatches;
+    }
+
+    if ((pChunks = (CHUNK *) calloc((size_t) n, sizeof(CHUNK))) == NULL)
+        Abort("error, unable to allocate chunk contexts");
+
+    ChunkLen = nLen / (unsigned long long) n;
+
+    for (i = 0; i < n; i++)
+    {
+        pChunks[i].Ctx = *pCtrl;
+        pChunks[i].Ctx.pFmtBuf = NULL;   /* grown per context on demand */
+        pChunks[i].Ctx.FmtSiz = 0;
+        pChunks[i].Base = (unsigned long long) i * ChunkLen;
+        pChunks[i].pData = pMem + pChunks[i].Base;
+
+        Tail = nLen - pChunks[i].Base;
+        pChunks[i].nData = ChunkLen + (unsigned long long) (nItemsSearch - 1);
+        if (i == n - 1 || pChunks[i].nData > Tail)
+            pChunks[i].nData = Tail;
+
+        if (pthread_create(&pChunks[i].Thread, NULL, ChunkWorker, &pChunks[i]) != 0)
+            Abort("internal error, unable to create a worker thread");
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        pthread_join(pChunks[i].Thread, NULL);
+
+        nMatches += pChunks[i].nMatches;
+        if (pChunks[i].TextLen > 0)
+            fwrite(pChunks[i].pText, 1, pChunks[i].TextLen, pCtrl->fpMsg);
+
+        free(pChunks[i].pText);
+        free(pChunks[i].Ctx.pFmtBuf);
+    }
+
+    free(pChunks);
+    return nMatches;
+}
+
+#ifdef SEEK_HOLE
+/* Input  : pCtrl - context whose input file may be sparse
+ *          pnMatches - receives the number of matches found
+ * Returns: 1 - file was handled here
+ *          0 - not sparse enough, caller should scan normally
+ *
+ * Skips the holes of a sparse file instead of streaming their zeros
+ * through the delta loop. Holes read as zeros, so a pattern with at
+ * least one nonzero byte can only match within a pattern length of a
+ * hole's edges; the data extents are enumerated with SEEK_DATA and
+ * SEEK_HOLE and handed to the block engine padded by a pattern length
+ * on both sides, read straight from the file so the padding bytes are
+ * the real edge bytes. Holes shorter than a search buffer are read
+ * through rather than skipped - a buffer of zeros costs less than the
+ * extra seek round trips - which also keeps the skipped holes too
+ * wide for any match, or any padding overlap, to span.
+ */
+static int SparseSearch(OUTPUT_CTRL *pCtrl, long *pnMatches)
+{
+    int   fd;
+    struct stat StatBuf;
+    off_t Data, Hole, Next, SegStart, SegEnd;
+    unsigned char *pBuf;
+    unsigned long long n;
+    long  nTotal = 0;
+    off_t Pad = (off_t) nItemsSearch - 1;
+    int   fDone = 0;
+    unsigned int i;
+
+    /* only the single pattern block engine is driven this way, and
+     * the statistics counters belong to the stream engine
+     */
+    if (nRules > 1 || fAsyncRead || BMG_fStats)
+        return 0;
+
+    /* a pattern of nothing but zero bytes matches inside the holes
+     * themselves, so nothing can be skipped
+     */
+    for (i = 0; i < nItemsSearch; i++)
+        if (SearchBuf[i] != 0)
+            break;
+    if (i == nItemsSearch)
+        return 0;
+
+    if ((fd = open(pCtrl->pInputFile, O_RDONLY)) == -1)
+        return 0;
+
+    /* not worth the trouble unless at least a buffer's worth of the
+     * file is actually missing
+     */
+    if (fstat(fd, &StatBuf) != 0 || !S_ISREG(StatBuf.st_mode) ||
+        (unsigned long long) StatBuf.st_blocks * 512ULL +
+        (unsigned long long) BMG_BufSiz >= (unsigned long long) StatBuf.st_size)
+    {
+        close(fd);
+        return 0;
+    }
+
+    if ((pBuf = (unsigned char *) malloc((size_t) BMG_BufSiz)) == NULL)
+        Abort("error, unable to allocate search buffer");
+
+    Data = lseek(fd, 0, SEEK_DATA);
+
+    while (!fDone && Data != -1 && Data < StatBuf.st_size)
+    {
+        if ((Hole = lseek(fd, Data, SEEK_HOLE)) == -1)
+            Hole = StatBuf.st_size;
+
+        /* pull short holes into the segment */
+        while (Hole < StatBuf.st_size)
+        {
+            if ((Next = lseek(fd, Hole, SEEK_DATA)) == -1)
+                break;
+            if (Next - Hole >= (off_t) BMG_BufSiz)
+                break;
+            if ((Hole = lseek(fd, Next, SEEK_HOLE)) == -1)
+                Hole = StatBuf.st_size;
+        }
+
+        SegStart = (Data > Pad) ? Data - Pad : 0;
+        SegEnd = (Hole + Pad < StatBuf.st_size) ? Hole + Pad : StatBuf.st_size;
+
+        while (SegStart < SegEnd)
+        {
+            n = (unsigned long long) (SegEnd - SegStart);
+            if (n > (unsigned long long) BMG_BufSiz)
+                n = (unsigned long long) BMG_BufSiz;
+
+            if (pread(fd, pBuf, (size_t) n, SegStart) != (ssize_t) n)
+            {
+                fDone = 1;
+                break;
+            }
+
+            nTotal += BMG_SearchMem(pCtrl, pBuf, n,
+                                    (unsigned long long) SegStart);
+            ProgAdd(n);
+
+            if (BMG_MatchLimit != 0 && nTotal >= BMG_MatchLimit)
+            {
+                nTotal = BMG_MatchLimit;
+                fDone = 1;
+                break;
+            }
+
+            if (SegStart + (off_t) n >= SegEnd)
+                break;
+
+            /* keep a pattern length of overlap, the same carryover
+             * the buffer refill uses
+             */
+            SegStart += (off_t) n - Pad;
+        }
+
+        Data = lseek(fd, Hole, SEEK_DATA);
+    }
+
+    free(pBuf);
+
+    if (fNoCache)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+
+    *pnMatches = nTotal;
+    return 1;
+}
+#endif /* SEEK_HOLE */
+
+/* Input  : pCtrl - context whose input file is to be searched
+ *          pnMatches - receives the number of matches found
+ * Returns: 1 - file was searched through a memory mapping
+ *          0 - mapping failed, caller should fall back to buffered search
+ *
+ * Maps the current input file into memory and runs the BMG skip loop
+ * directly over the mapping, avoiding the read and copy per buffer refill.
+ */
+static int MappedSearch(OUTPUT_CTRL *pCtrl, long *pnMatches)
+{
+    int fd;
+    struct stat StatBuf;
+    unsigned char *pMap;
+
+    if ((fd = open(pCtrl->pInputFile, O_RDONLY)) == -1)
+        return 0;
+
+    if (fstat(fd, &StatBuf) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    if (StatBuf.st_size == 0)   /* nothing to map, nothing to match */
+    {
+        close(fd);
+        *pnMatches = 0;
+        return 1;
+    }
+
+    pMap = (unsigned char *) mmap(NULL, (size_t) StatBuf.st_size, PROT_READ,
+                                  MAP_PRIVATE, fd, 0);
+
+    /* the mapping keeps its own reference, but dropping the cache
+     * afterwards needs the descriptor, so hold on to it until then
+     */
+    if (!fNoCache)
+    {
+        close(fd);
+        fd = -1;
+    }
+
+    if (pMap == MAP_FAILED)
+    {
+        if (fd != -1)
+            close(fd);
+        return 0;
+    }
+
+    madvise(pMap, (size_t) StatBuf.st_size, MADV_SEQUENTIAL);
+
+    /* only the serial driver may split the file across the workers; the
+     * file pool already runs one file per thread, and a match limit is
+     * a per file count the chunks could not respect independently
+     */
+    if (nWorkers > 1 && pCtrl == &Ctrl && BMG_MatchLimit == 0)
+        *pnMatches = ChunkedSearchMem(pCtrl, pMap, (unsigned long long) StatBuf.st_size);
+    else
+        *pnMatches = BMG_SearchMem(pCtrl, pMap, (unsigned long long) StatBuf.st_size, 0);
+
+    munmap(pMap, (size_t) StatBuf.st_size);
+
+    if (fd != -1)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+    return 1;
+}
+#endif
+
+/* Searches a single input file. All messages go through the context
+ * so the function can be driven from worker threads as well as from
+ * the serial loop in FileSearch.
+ */
+static void SearchOneFile(OUTPUT_CTRL *pCtrl)
+{
+    long  nMatches;
+
+    /* an unchanged file is answered from the scan cache without
+     * being opened at all
+     */
+    if (CacheProbe(pCtrl, &nMatches))
+    {
+        if (nMatches > 0)
+            fFoundMatch = 1;
+
+        if ((nMatches > 0 || fServe) && !fQuiet && !pCtrl->fRecords)
+            fprintf(pCtrl->fpMsg, "%s: %ld match%s found\n",
+                    pCtrl->pInputFile, nMatches, (nMatches == 1) ? "" : "es");
+
+        SumFile(pCtrl->pInputFile, nMatches);
+        return;
+    }
+
+    if (fTextOnly && BinaryFile(pCtrl))
+    {
+        /* serve mode owes its driver one response per name */
+        if (fServe)
+            fprintf(pCtrl->fpMsg, "%s: binary, skipped\n", pCtrl->pInputFile);
+        SumSkip();
+        return;
+    }
+
+#ifdef __UNIX__
+    if (fUseMmap && MappedSearch(pCtrl, &nMatches))
+    {
+        if (nMatches > 0)
+            fFoundMatch = 1;
+
+        if ((nMatches > 0 || fServe) && !fQuiet && !pCtrl->fRecords)
+            fprintf(pCtrl->fpMsg, "%s: %ld match%s found\n",
+                    pCtrl->pInputFile, nMatches, (nMatches == 1) ? "" : "es");
+
+        CacheStore(pCtrl->pInputFile, nMatches);
+        SumFile(pCtrl->pInputFile, nMatches);
+        return;
+    }
+
+#ifdef SEEK_HOLE
+    if (!fUseMmap && SparseSearch(pCtrl, &nMatches))
+    {
+        if (nMatches > 0)
+            fFoundMatch = 1;
+
+        if ((nMatches > 0 || fServe) && !fQuiet && !pCtrl->fRecords)
+            fprintf(pCtrl->fpMsg, "%s: %ld match%s found\n",
+                    pCtrl->pInputFile, nMatches, (nMatches == 1) ? "" : "es");
+
+        CacheStore(pCtrl->pInputFile, nMatches);
+        SumFile(pCtrl->pInputFile, nMatches);
+        return;
+    }
+#endif
+#endif
+
+    if ((pCtrl->fpIn = fopen(pCtrl->pInputFile, "rb")) == NULL)
+    {
+        fprintf(pCtrl->fpMsg, "gsar: unable to open input file '%s'\n", pCtrl->pInputFile);
+        SumSkip();
+        return;
+    }
+
+#if defined(MSDOS) && (!defined(__ZTC__)) || (defined(__ZTC__) && !defined(__SMALL__))
+    /* Don't use setvbuf if we're compiling under Zortech small model
+     */
+    if (setvbuf(pCtrl->fpIn, NULL, _IOFBF, SETVBUF_SIZ) != 0)
+        fprintf(pCtrl->fpMsg, "warning, unable to set up buffering for input file\n");
+#endif
+
+#ifdef __UNIX__
+    AdviseSequential(pCtrl->fpIn);
+
+    if (fAsyncRead)
+        nMatches = BMG_SearchAsync(pCtrl);
+    else
+#endif
+        nMatches = (nRules > 1) ? BMG_MultiSearch(pCtrl) : BMG_Search(pCtrl);
+
+#ifdef __UNIX__
+    DropCache(pCtrl->fpIn);
+#endif
+    fclose(pCtrl->fpIn);
+
+    if (nMatches > 0)
+        fFoundMatch = 1;
+
+    if ((nMatches > 0 || fServe) && !fQuiet && !pCtrl->fRecords)
+        fprintf(pCtrl->fpMsg, "%s: %ld match%s found\n",
+                pCtrl->pInputFile, nMatches, (nMatches == 1) ? "" : "es");
+
+    CacheStore(pCtrl->pInputFile, nMatches);
+    SumFile(pCtrl->pInputFile, nMatches);
+
+    if (BMG_fStats)
+    {
+        BMG_StatsReport(pCtrl, &BMG_Stats, pCtrl->pInputFile);
+        BMG_StatsFold();
+    }
+}
+
+/* Performs a BMG search on one or multiple files. The files
+ * to process are found in pFileList. Files that cannot be
+ * opened are just ignored.
+ */
+void FileSearch(void)
+{
+    while (*pFileList != NULL)
+    {
+        Ctrl.pInputFile = *pFileList++;
+
+        if (!fCheckFile(&Ctrl, Ctrl.pInputFile))
+            continue;
+
+        Ctrl.fpMsg = stdout;
+        SearchOneFile(&Ctrl);
+    }
+}
+
+/* Input  : pCtrl - context for eventual warnings
+ * Returns: open output stream, aborts on failure
+ *
+ * Opens the output file named on the command line. Installed as the
+ * open hook so a run without matches never creates the file.
+ */
+static FILE *OpenNamedOut(OUTPUT_CTRL *pCtrl)
+{
+    FILE *fp;
+
+    if ((fp = fopen(pOutFile, "wb")) == NULL)
+        Abort("error, unable to open output file '%s' ", pOutFile);
+
+    pCtrl->pOutName = pOutFile;
+
+#if defined(MSDOS) && (!defined(__ZTC__)) || (defined(__ZTC__) && !defined(__SMALL__))
+    /* Don't use setvbuf if we're compiling under Zortech small model
+     */
+    if (setvbuf(fp, NULL, _IOFBF, SETVBUF_SIZ) != 0)
+        fprintf(pCtrl->fpMsg, "warning, unable to set up buffering for output file\n");
+#endif
+
+    return fp;
+}
+
+/* Performs a search and replace on a specific outputfile
+ */
+void OneSearchReplace(void)
+{
+    long  nMatches = 0;
+    struct stat StatBuf;    /* struct so we can access file information */
+
+    Ctrl.fpMsg = stdout;    /* redirect messages */
+    Ctrl.pInputFile = NULL; /* initially we haven't found a file */
+
+    /* find the input and output file
+     */
+    while (*pFileList != NULL)
+    {
+        if (Ctrl.pInputFile == NULL)
+            Ctrl.pInputFile = *pFileList;
+        else if (pOutFile == NULL)
+            pOutFile = *pFileList;
+
+        pFileList++;
+    }
+
+    if (!fCheckFile(&Ctrl, Ctrl.pInputFile))
+    {
+        /* Message has already been given */
+        exit(EXIT_FAILURE);
+    }
+    else
+        Ctrl.fpIn = fopen(Ctrl.pInputFile, "rb");
+
+    if (Ctrl.fpIn == NULL)
+        Abort("error, unable to open input file '%s'", Ctrl.pInputFile);
+
+    if ((stat(pOutFile, &StatBuf)) == 0 && !fForce)   /* stat got the info ie. file exists */
+        Abort("error, output file '%s' already exists. Use the 'f' option to force overwrite", pOutFile);
+
+#if defined(MSDOS) && (!defined(__ZTC__)) || (defined(__ZTC__) && !defined(__SMALL__))
+    /* Don't use setvbuf if we're compiling under Zortech small model
+     */
+    if (setvbuf(Ctrl.fpIn, NULL, _IOFBF, SETVBUF_SIZ) != 0)
+        fprintf(Ctrl.fpMsg, "warning, unable to set up buffering for input file\n");
+#endif
+
+#ifdef __UNIX__
+    AdviseSequential(Ctrl.fpIn);
+#endif
+
+    /* the output file is only created when the first match arrives */
+    Ctrl.fpOut = NULL;
+    Ctrl.pOutName = NULL;
+    Ctrl.pfOpenOut = OpenNamedOut;
+
+    if (nRules > 1)
+    {
+        /* the multi pattern engine writes from the very start */
+        Ctrl.fpOut = OpenNamedOut(&Ctrl);
+        nMatches = BMG_MultiSearchReplace(&Ctrl);
+    }
+    else
+        nMatches = BMG_SearchReplace(&Ctrl, ReplaceBuf, nItemsReplace);
+
+#ifdef __UNIX__
+    DropCache(Ctrl.fpIn);
+#endif
+    fclose(Ctrl.fpIn);
+    if (Ctrl.fpOut != NULL)
+        fclose(Ctrl.fpOut);
+
+    fCriticalPart = 1;    /* ignore interrupts here */
+
+    if (nMatches == -1)   /* error in writing file */
+    {
+        fprintf(Ctrl.fpMsg, "gsar: error in writing file '%s' - cleaning up\n", pOutFile);
+        if (Ctrl.pOutName != NULL && remove(pOutFile) != 0)
+            Abort("error, unable to remove output file '%s'", pOutFile);
+        exit(EXIT_FAILURE);  /* exit & tell operating system that we've failed */
+    }
+
+    if (nMatches == 0)
+    {
+        /* only the eagerly opened multi pattern output exists here */
+        if (Ctrl.pOutName != NULL && remove(pOutFile) != 0)
+            Abort("error, unable to remove output file '%s'", pOutFile);
+    }
+    else
+        fprintf(Ctrl.fpMsg, "%s: %ld occurrence%s changed\n",
+                Ctrl.pInputFile, nMatches, (nMatches > 1) ? "s" : "");
+
+    SumFile(Ctrl.pInputFile, nMatches);
+
+    if (BMG_fStats)
+    {
+        BMG_StatsReport(&Ctrl, &BMG_Stats, Ctrl.pInputFile);
+        BMG_StatsFold();
+    }
+
+    /* Make sure the Ctrl-C handler does not delete a completly
+     * processed output file
+     */
+    pOutFile = NULL;
+
+    fCriticalPart = 0;   /* enable interrupts */
+}
+
+
+#ifdef __UNIX__
+/* pOutFile is shared with the interrupt handler, so updates from
+ * worker threads are serialized
+ */
+static pthread_mutex_t TmpLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Patches matches in a single input file in place, only touching the
+ * matched byte ranges. Only valid when the search and replace strings
+ * have the same length.
+ */
+static void PatchOneFile(OUTPUT_CTRL *pCtrl)
+{
+    long  nMatches;
+
+    if ((pCtrl->fpIn = fopen(pCtrl->pInputFile, "r+b")) == NULL)
+    {
+        fprintf(pCtrl->fpMsg, "gsar: unable to open input file '%s' for update\n", pCtrl->pInputFile);
+        SumSkip();
+        return;
+    }
+
+#ifdef __UNIX__
+    /* the scan is sequential even though the patches are not; no cache
+     * drop here, the pages just written are the ones most likely to be
+     * read back
+     */
+    AdviseSequential(pCtrl->fpIn);
+#endif
+
+    nMatches = BMG_ReplaceInPlace(pCtrl, ReplaceBuf, nItemsReplace);
+    fclose(pCtrl->fpIn);
+
+    if (nMatches == -1)   /* error in writing file */
+    {
+        fprintf(pCtrl->fpMsg, "gsar: error in writing file '%s'\n", pCtrl->pInputFile);
+        exit(EXIT_FAILURE);
+    }
+
+    if (nMatches > 0 || fServe)
+        fprintf(pCtrl->fpMsg, "%s: %ld occurrence%s changed\n",
+                pCtrl->pInputFile, nMatches, (nMatches == 1) ? "" : "s");
+
+    SumFile(pCtrl->pInputFile, nMatches);
+}
+
+/* Input  : pCtrl - context naming the input file
+ * Returns: open temporary output stream, aborts on failure
+ *
+ * Creates a temporary output file with prefix 'gsr_' next to the input
+ * file and hands its name to the context. Installed as the open hook
+ * for the replace engine, which only calls it when the first match
+ * arrives, so files without matches never cause a temp file at all.
+ */
+static FILE *OpenTmpOut(OUTPUT_CTRL *pCtrl)
+{
+    FILE *fp;
+    char *pTmpFile;
+#ifdef __UNIX__
+    int   fd;
+    char *pTmpPath;
+    struct stat stat_buf;
+    /*
+      - some compilers mess this up...
+      extern int chown(char *, uid_t, gid_t);
+      extern int chmod(char *, mode_t);
+    */
+#endif
+
+#ifdef __UNIX__
+    /* one atomic exclusive create in the input directory; no probe
+     * loop, so leftover gsr_*.tmp files from interrupted runs do not
+     * slow later runs down, and workers need no serialization
+     */
+    pTmpPath = ExtractPathFromFSpec(pCtrl->pInputFile);
+    if ((pTmpFile = (char *) malloc(strlen(pTmpPath) + sizeof("gsr_XXXXXX.tmp"))) == NULL)
+        Abort("error, unable to create a temporary file name");
+    sprintf(pTmpFile, "%sgsr_XXXXXX.tmp", pTmpPath);
+    free(pTmpPath);
+
+    if ((fd = mkstemps(pTmpFile, 4)) == -1)
+        Abort("error, unable to open output file '%s' ", pTmpFile);
+    if ((fp = fdopen(fd, "wb")) == NULL)
+        Abort("error, unable to open output file '%s' ", pTmpFile);
+
+    pthread_mutex_lock(&TmpLock);
+    pOutFile = pTmpFile;
+    pthread_mutex_unlock(&TmpLock);
+#else
+    /* generate a temporary file name with prefix 'gsr_'
+       */
+    pTmpFile = ExtractPathFromFSpec(pCtrl->pInputFile);
+    if ((pTmpFile = TmpName(pTmpFile, "gsr_")) == NULL)
+        Abort("error, unable to create a temporary file name");
+
+    if ((fp = fopen(pTmpFile, "wb")) == NULL)
+        Abort("error, unable to open output file '%s' ", pTmpFile);
+
+    pOutFile = pTmpFile = DupStr(pTmpFile);
+#endif
+
+    pCtrl->pOutName = pTmpFile;
+
+#ifdef __UNIX__
+    /* In Unix, we try to preserve the mode and id's of the file : */
+    if (stat(pCtrl->pInputFile, &stat_buf) != -1)
+    {
+        /* Get around gcc warnings */
+        if (chown(pTmpFile, stat_buf.st_uid, stat_buf.st_gid)) {};
+        chmod(pTmpFile, stat_buf.st_mode);
+    }
+    /* We just ignore errors here ... (hpv) */
+#endif
+
+#if defined(MSDOS) && (!defined(__ZTC__)) || (defined(__ZTC__) && !defined(__SMALL__))
+    /* Don't use setvbuf if we're compiling under Zortech small model
+       */
+    if (setvbuf(fp, NULL, _IOFBF, SETVBUF_SIZ) != 0)
+        fprintf(pCtrl->fpMsg, "warning, unable to set up buffering for output file\n");
+#endif
+
+    return fp;
+}
+
+/* Replaces in a single input file through a temporary file which is
+ * renamed over the original. The temp file is created lazily by the
+ * engine on the first match, so the no match majority of a batch run
+ * costs no write I/O. All messages go through the context so the
+ * function can be driven from worker threads as well as from the
+ * serial loop in SearchReplace.
+ */
+static void ReplaceOneFile(OUTPUT_CTRL *pCtrl)
+{
+    long  nMatches;
+
+    /* same length replacements can be patched without the rewrite,
+     * anything else falls back to the temp file copy below
+     */
+    if (fInPlace && nRules <= 1 && nItemsSearch == nItemsReplace)
+    {
+        PatchOneFile(pCtrl);
+        return;
+    }
+
+    if ((pCtrl->fpIn = fopen(pCtrl->pInputFile, "rb")) == NULL)
+    {
+        fprintf(pCtrl->fpMsg, "gsar: unable to open input file '%s'\n", pCtrl->pInputFile);
+        SumSkip();
+        return;
+    }
+
+#if defined(MSDOS) && (!defined(__ZTC__)) || (defined(__ZTC__) && !defined(__SMALL__))
+    /* Don't use setvbuf if we're compiling under Zortech small model
+       */
+    if (setvbuf(pCtrl->fpIn, NULL, _IOFBF, SETVBUF_SIZ) != 0)
+        fprintf(pCtrl->fpMsg, "warning, unable to set up buffering for input file\n");
+#endif
+
+    pCtrl->fpOut = NULL;
+    pCtrl->pOutName = NULL;
+    pCtrl->pfOpenOut = OpenTmpOut;
+
+#ifdef __UNIX__
+    AdviseSequential(pCtrl->fpIn);
+#endif
+
+    if (nRules > 1)
+    {
+        /* the multi pattern engine writes from the very start */
+        pCtrl->fpOut = OpenTmpOut(pCtrl);
+        nMatches = BMG_MultiSearchReplace(pCtrl);
+    }
+    else
+        nMatches = BMG_SearchReplace(pCtrl, ReplaceBuf, nItemsReplace);
+
+#ifdef __UNIX__
+    DropCache(pCtrl->fpIn);
+#endif
+    fclose(pCtrl->fpIn);
+    if (pCtrl->fpOut != NULL)
+        fclose(pCtrl->fpOut);
+
+    fCriticalPart = 1;    /* ignore interrupts here */
+
+    if (nMatches == -1)   /* error in writing file */
+    {
+        fprintf(pCtrl->fpMsg, "gsar: error in writing file '%s' - cleaning up\n", pCtrl->pInputFile);
+        if (pCtrl->pOutName != NULL && remove(pCtrl->pOutName) != 0)
+            Abort("error, unable to remove output file '%s'", pCtrl->pOutName);
+        exit(EXIT_FAILURE);
+    }
+
+    if (nMatches == 0)
+    {
+        /* only the eagerly opened multi pattern temp file exists here */
+        if (pCtrl->pOutName != NULL && remove(pCtrl->pOutName) != 0)
+            Abort("error, unable to remove output file '%s'", pCtrl->pOutName);
+
+        if (fServe)
+            fprintf(pCtrl->fpMsg, "%s: 0 occurrences changed\n", pCtrl->pInputFile);
+    }
+    else
+    {
+        /* if we can't remove the input file delete the tmp output file
+           */
+        if (remove(pCtrl->pInputFile) != 0)
+        {
+            fprintf(pCtrl->fpMsg, "gsar: error, unable to remove input file '%s' before rename (read-only ?)", pCtrl->pInputFile);
+            if (remove(pCtrl->pOutName) != 0)
+                Abort("error, unable to remove output file '%s'", pCtrl->pOutName);
+            exit(EXIT_FAILURE);
+        }
+
+        if (rename(pCtrl->pOutName, pCtrl->pInputFile) != 0)
+            Abort("error, unable to rename file '%s' to '%s'", pCtrl->pOutName, pCtrl->pInputFile);
+
+        fprintf(pCtrl->fpMsg, "%s: %ld occurrence%s changed\n",
+                pCtrl->pInputFile, nMatches, (nMatches > 1) ? "s" : "");
+    }
+
+    if (BMG_fStats)
+    {
+        BMG_StatsReport(pCtrl, &BMG_Stats, pCtrl->pInputFile);
+        BMG_StatsFold();
+    }
+
+    SumFile(pCtrl->pInputFile, nMatches);
+
+    pOutFile = NULL;
+    if (pCtrl->pOutName != NULL)
+    {
+        free(pCtrl->pOutName);
+        pCtrl->pOutName = NULL;
+    }
+    fCriticalPart = 0;
+}
+
+/* Performs a BMG search and replace on one or multiple files. The files
+ * to process are found in pFileList. Files that cannot be opened
+ * are ignored.
+ */
+void SearchReplace(void)
+{
+    Ctrl.fpMsg = stdout;    /* redirect messages */
+
+    while (*pFileList != NULL)
+    {
+        Ctrl.pInputFile = *pFileList++;
+
+        if (!fCheckFile(&Ctrl, Ctrl.pInputFile))
+            continue;
+
+        ReplaceOneFile(&Ctrl);
+    }
+}
+
+
+/* Chunked arena for file names streamed with the '@' option; names are
+ * stored back to back in large blocks so a million entry manifest does
+ * not cost an allocator call per name. The blocks live for the rest of
+ * the run, just like the names in argv.
+ */
+#define LIST_CHUNK  0x10000    /* allocation unit for list names */
+
+static char *pArenaCur = NULL;  /* write position in the current block */
+static long  nArenaLeft = 0;    /* bytes left in the current block */
+
+static char *ArenaStore(char *pName, int nLen)
+{
+    char *p;
+
+    if (nLen + 1 > nArenaLeft)
+    {
+        long nBlock = (nLen + 1 > LIST_CHUNK) ? nLen + 1 : LIST_CHUNK;
+
+        if ((pArenaCur = (char *) malloc((size_t) nBlock)) == NULL)
+            Abort("error, unable to allocate file name arena");
+        nArenaLeft = nBlock;
+    }
+
+    p = pArenaCur;
+    memcpy(p, pName, nLen);
+    p[nLen] = '\0';
+    pArenaCur += nLen + 1;
+    nArenaLeft -= nLen + 1;
+    return p;
+}
+
+/* Input  : fp - open list stream
+ * Returns: the next file name from the list, NULL at end of input
+ *
+ * Names are terminated by NUL, LF or the end of the input; a CR before
+ * the LF and empty names are dropped so DOS style lists and blank
+ * lines both work.
+ */
+static char *NextListName(FILE *fp)
+{
+    char Name[4096];
+    int  c;
+    int  n;
+
+    for (;;)
+    {
+        n = 0;
+        while ((c = getc(fp)) != EOF && c != '\0' && c != '\n')
+        {
+            if (n >= (int) sizeof(Name) - 1)
+                Abort("error, file name in list is too long");
+            Name[n++] = (char) c;
+        }
+
+        if (n > 0 && Name[n - 1] == '\r')
+            n--;
+
+        if (n > 0)
+            return ArenaStore(Name, n);
+
+        if (c == EOF)
+            return NULL;
+    }
+}
+
+#ifdef __UNIX__
+/* Worker pool for the 'j' and 'R' options. Workers claim files from a
+ * shared list through a shared index, which keeps all threads busy until
+ * the very last file regardless of how unevenly the file sizes are
+ * distributed. With 'j' the list is pFileList and complete from the
+ * start; with 'R' a producer thread walks the directory trees and
+ * appends files while the workers are already searching. Each worker
+ * captures its output in a memory stream so the per file result lines
+ * can be emitted in discovery order.
+ */
+static pthread_mutex_t PoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  PoolCond = PTHREAD_COND_INITIALIZER;
+static char **pPoolList;     /* files to process */
+static int    NextFile;      /* next file index to claim */
+static int    EmitFile;      /* next file index to emit output for */
+static int    nPoolFiles;    /* number of files queued so far */
+static int    nPoolCap;      /* allocated size of the pool arrays */
+static int    fWalkDone;     /* no more files will be queued */
+static char **pPoolOut;      /* captured output, one entry per file */
+static size_t *pPoolLen;     /* length of the captured output; fputs
+                              * would stop at the NULs of record mode */
+static signed char *pPoolDone;  /* processed flag, one entry per file */
+
+/* Appends one file name to the pool, growing the arrays as needed, and
+ * wakes up a waiting worker. Called by the directory walker.
+ */
+static void QueueFile(char *pName)
+{
+    pthread_mutex_lock(&PoolLock);
+
+    if (nPoolFiles == nPoolCap)
+    {
+        nPoolCap = (nPoolCap == 0) ? 64 : nPoolCap * 2;
+        pPoolList = (char **) realloc(pPoolList, nPoolCap * sizeof(char *));
+        pPoolOut = (char **) realloc(pPoolOut, nPoolCap * sizeof(char *));
+        pPoolLen = (size_t *) realloc(pPoolLen, nPoolCap * sizeof(size_t));
+        pPoolDone = (signed char *) realloc(pPoolDone, nPoolCap * sizeof(signed char));
+        if (pPoolList == NULL || pPoolOut == NULL || pPoolLen == NULL || pPoolDone == NULL)
+            Abort("error, unable to grow worker pool state");
+    }
+
+    pPoolList[nPoolFiles] = pName;
+    pPoolOut[nPoolFiles] = NULL;
+    pPoolLen[nPoolFiles] = 0;
+    pPoolDone[nPoolFiles] = 0;
+    nPoolFiles++;
+
+    pthread_cond_signal(&PoolCond);
+    pthread_mutex_unlock(&PoolLock);
+}
+
+/* Hands the captured output for file 'i' to the pool and flushes every
+ * completed entry that is next in line.
+ */
+static void PoolEmit(int i, char *pText, size_t nText)
+{
+    pthread_mutex_lock(&PoolLock);
+
+    pPoolOut[i] = pText;
+    pPoolLen[i] = nText;
+    pPoolDone[i] = 1;
+
+    while (EmitFile < nPoolFiles && pPoolDone[EmitFile])
+    {
+        if (pPoolOut[EmitFile] != NULL)
+        {
+            fwrite(pPoolOut[EmitFile], 1, pPoolLen[EmitFile], stdout);
+            free(pPoolOut[EmitFile]);
+        }
+        EmitFile++;
+    }
+
+    pthread_mutex_unlock(&PoolLock);
+}
+
+static void *PoolWorker(void *pArg)
+{
+    OUTPUT_CTRL Ctx;
+    char   *pText;
+    size_t  TextLen;
+    int     i;
+
+    Ctx = Ctrl;                     /* inherit the global flags */
+    Ctx.pBuffer = BMG_AllocBuffer();
+    if (Ctx.pBuffer == NULL)
+        Abort("error, unable to allocate search buffer for worker");
+
+    for (;;)
+    {
+        pthread_mutex_lock(&PoolLock);
+        while (NextFile >= nPoolFiles && !fWalkDone)
+            pthread_cond_wait(&PoolCond, &PoolLock);
+
+        if (NextFile >= nPoolFiles)
+        {
+            pthread_mutex_unlock(&PoolLock);
+            break;
+        }
+
+        i = NextFile++;
+        Ctx.pInputFile = pPoolList[i];   /* the list may be realloc'd, so
+                                          * fetch the entry under the lock */
+        pthread_mutex_unlock(&PoolLock);
+
+        pText = NULL;
+        if ((Ctx.fpMsg = open_memstream(&pText, &TextLen)) == NULL)
+            Abort("error, unable to set up output stream for worker");
+
+        if (fCheckFile(&Ctx, Ctx.pInputFile))
+        {
+            if (fSearchReplace)
+                ReplaceOneFile(&Ctx);
+            else
+                SearchOneFile(&Ctx);
+        }
+
+        fclose(Ctx.fpMsg);
+        PoolEmit(i, pText, TextLen);
+    }
+
+    free(Ctx.pBuffer);
+    return NULL;
+}
+
+/* Input  : nFiles - number of entries in pFileList
+ * Returns: nothing
+ *
+ * Runs the search or search & replace over pFileList with nWorkers
+ * threads pulling files from the shared index.
+ */
+static void ParallelRun(int nFiles)
+{
+    pthread_t *pThreads;
+    int i;
+
+    pPoolList = pFileList;
+    nPoolFiles = nFiles;
+    nPoolCap = nFiles;
+    NextFile = 0;
+    EmitFile = 0;
+    fWalkDone = 1;         /* the whole list is known up front */
+
+    pPoolOut = (char **) calloc(nFiles, sizeof(char *));
+    pPoolLen = (size_t *) calloc(nFiles, sizeof(size_t));
+    pPoolDone = (signed char *) calloc(nFiles, sizeof(signed char));
+    pThreads = (pthread_t *) malloc(nWorkers * sizeof(pthread_t));
+    if (pPoolOut == NULL || pPoolLen == NULL || pPoolDone == NULL || pThreads == NULL)
+        Abort("error, unable to allocate worker pool state");
+
+    for (i = 0; i < nWorkers; i++)
+        if (pthread_create(&pThreads[i], NULL, PoolWorker, NULL) != 0)
+            Abort("error, unable to create worker thread");
+
+    for (i = 0; i < nWorkers; i++)
+        pthread_join(pThreads[i], NULL);
+
+    free(pThreads);
+    free(pPoolOut);
+    free(pPoolLen);
+    free(pPoolDone);
+}
+
+/* Input  : pName - file name without path
+ * Returns: 1 if the file is to be processed, 0 if not
+ *
+ * Applies the 'g' globs to a file name. A name is excluded if it
+ * matches any '!' glob. If plain globs were given the name must in
+ * addition match one of them, otherwise every name is accepted.
+ */
+static int fNameWanted(char *pName)
+{
+    int i;
+    int fHaveInclude = 0;
+    int fIncluded = 0;
+
+    for (i = 0; i < nNameGlobs; i++)
+    {
+        if (*pNameGlobs[i] == '!')
+        {
+            if (fnmatch(pNameGlobs[i] + 1, pName, 0) == 0)
+                return 0;
+        }
+        else
+        {
+            fHaveInclude = 1;
+            if (fnmatch(pNameGlobs[i], pName, 0) == 0)
+                fIncluded = 1;
+        }
+    }
+
+    return fHaveInclude ? fIncluded : 1;
+}
+
+/* Walks a directory tree depth first and queues every regular file
+ * that passes the glob filter. Symbolic links are not followed so a
+ * link cycle cannot send us round in circles.
+ */
+static void WalkDir(char *pDir)
+{
+    DIR *pHandle;
+    struct dirent *pEntry;
+    struct stat StatBuf;
+    char *pPath;
+
+    if ((pHandle = opendir(pDir)) == NULL)
+    {
+        fprintf(stderr, "gsar: unable to read directory '%s'\n", pDir);
+        return;
+    }
+
+    while ((pEntry = readdir(pHandle)) != NULL)
+    {
+        if (strcmp(pEntry->d_name, ".") == 0 || strcmp(pEntry->d_name, "..") == 0)
+            continue;
+
+        pPath = (char *) malloc(strlen(pDir) + strlen(pEntry->d_name) + 2);
+        if (pPath == NULL)
+            Abort("error, unable to allocate file name");
+        sprintf(pPath, "%s/%s", pDir, pEntry->d_name);
+
+        if (lstat(pPath, &StatBuf) != 0)
+        {
+            free(pPath);
+            continue;
+        }
+
+        if (S_ISDIR(StatBuf.st_mode))
+        {
+            WalkDir(pPath);
+            free(pPath);
+        }
+        else if (S_ISREG(StatBuf.st_mode) && fNameWanted(pEntry->d_name))
+            QueueFile(pPath);    /* the pool owns the name now */
+        else
+            free(pPath);
+    }
+
+    closedir(pHandle);
+}
+
+/* Producer thread for the 'R' option. Queues any explicit file names
+ * first, then walks the requested directory trees, and finally wakes
+ * every worker so those that ran dry can terminate.
+ */
+static void *WalkProducer(void *pArg)
+{
+    int i;
+
+    if (pFileList != NULL)
+        while (*pFileList != NULL)
+            QueueFile(*pFileList++);
+
+    for (i = 0; i < nRecurseDirs; i++)
+        WalkDir(pRecurseDirs[i]);
+
+    pthread_mutex_lock(&PoolLock);
+    fWalkDone = 1;
+    pthread_cond_broadcast(&PoolCond);
+    pthread_mutex_unlock(&PoolLock);
+
+    return NULL;
+}
+
+/* Producer thread for the '@' option; streams names from the list and
+ * queues each one the moment it is complete, so the workers already
+ * search while the manifest is still being read.
+ */
+static void *ListProducer(void *pArg)
+{
+    FILE *fp = (FILE *) pArg;
+    char *pName;
+
+    while ((pName = NextListName(fp)) != NULL)
+        QueueFile(pName);
+
+    pthread_mutex_lock(&PoolLock);
+    fWalkDone = 1;
+    pthread_cond_broadcast(&PoolCond);
+    pthread_mutex_unlock(&PoolLock);
+
+    return NULL;
+}
+
+/* Runs the search or search & replace over a streamed list of files.
+ * The producer runs in its own thread and feeds the worker pool
+ * through the shared queue, so enumeration (directory walking or
+ * manifest reading) overlaps with the actual searching instead of
+ * serializing in front of it.
+ */
+static void ProducerRun(void *(*pfProducer)(void *), void *pArg)
+{
+    pthread_t  Producer;
+    pthread_t *pThreads;
+    int i;
+
+    pPoolList = NULL;
+    nPoolFiles = 0;
+    nPoolCap = 0;
+    NextFile = 0;
+    EmitFile = 0;
+    fWalkDone = 0;
+    pPoolOut = NULL;
+    pPoolLen = NULL;
+    pPoolDone = NULL;
+
+    if (pthread_create(&Producer, NULL, pfProducer, pArg) != 0)
+        Abort("error, unable to create producer thread");
+
+    pThreads = (pthread_t *) malloc(nWorkers * sizeof(pthread_t));
+    if (pThreads == NULL)
+        Abort("error, unable to allocate worker pool state");
+
+    for (i = 0; i < nWorkers; i++)
+        if (pthread_create(&pThreads[i], NULL, PoolWorker, NULL) != 0)
+            Abort("error, unable to create worker thread");
+
+    pthread_join(Producer, NULL);
+    for (i = 0; i < nWorkers; i++)
+        pthread_join(pThreads[i], NULL);
+
+    free(pThreads);
+    free(pPoolOut);
+    free(pPoolLen);
+    free(pPoolDone);
+    free(pPoolList);
+}
+#endif
+
+/* Processes the files named in the '@' list, searching or replacing
+ * according to the mode flags. Names are handled as they arrive, so
+ * the first file is already being searched while a million entry
+ * manifest is still streaming in.
+ */
+static void RunFileList(void)
+{
+    FILE *fp;
+    char *pName;
+
+    if (strcmp(pFileListName, "-") == 0)
+        fp = stdin;
+    else if ((fp = fopen(pFileListName, "rb")) == NULL)
+        Abort("error, unable to open file list '%s'", pFileListName);
+
+    Ctrl.fpMsg = stdout;
+
+#ifdef __UNIX__
+    if (nWorkers > 1)
+    {
+        ProducerRun(ListProducer, fp);
+        if (fp != stdin)
+            fclose(fp);
+        return;
+    }
+#endif
+
+    while ((pName = NextListName(fp)) != NULL)
+    {
+        Ctrl.pInputFile = pName;
+
+        if (!fCheckFile(&Ctrl, pName))
+            continue;
+
+        if (fSearchReplace)
+            ReplaceOneFile(&Ctrl);
+        else
+            SearchOneFile(&Ctrl);
+    }
+
+    if (fp != stdin)
+        fclose(fp);
+}
+
+/* Resident serve mode for the 'D' option. Reads file names from stdin
+ * one per line and processes each with the already compiled pattern
+ * state, so a driving script pays for process start and pattern setup
+ * once instead of once per file. Exactly one flushed summary line is
+ * written per name, matches or not, which lets the driver run the
+ * exchange synchronously over a pair of pipes.
+ */
+static void ServeStdin(void)
+{
+    char  Name[FILENAME_MAX + 1];
+    char *pEnd;
+
+    Ctrl.fpMsg = stdout;
+
+    while (fgets(Name, sizeof(Name), stdin) != NULL)
+    {
+        pEnd = Name + strlen(Name);
+        while (pEnd > Name && (pEnd[-1] == '\n' || pEnd[-1] == '\r'))
+            *--pEnd = '\0';
+
+        if (Name[0] == '\0')
+            continue;
+
+        Ctrl.pInputFile = Name;
+
+        if (fCheckFile(&Ctrl, Name))
+        {
+            if (fSearchReplace)
+                ReplaceOneFile(&Ctrl);
+            else
+                SearchOneFile(&Ctrl);
+        }
+
+        fflush(Ctrl.fpMsg);
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    int i;            /* number of files on command line */
+    unsigned int n;   /* rule counter */
+
+#if defined(__ZTC__)
+    /* Automatic response file expansion */
+    response_expand(&argc, &argv);
+#endif
+
+    Ctrl.fFileSpec = 1;
+    Ctrl.fpMsg = stdout;
+
+    if (signal(SIGINT, CtrlBreak) == SIG_ERR)
+        Abort("internal error, unable to set SIGINT");
+
+    /* parse command line arguments & set variables
+     * i is number of files found
+     */
+    i = GetArgs(argc, argv);
+
+    /* perform different health & sanity checks
+     */
+
+    if (nItemsSearch == 0)
+        Abort("command error, no search string specified");
+
+    /* the context must fit in the search buffer, whose size is now only
+     * known once the whole command line has been parsed
+     */
+    if ((long) Ctrl.Context > BMG_BufSiz)
+        Abort("command error, context size must not exceed the search buffer size (%ld)", BMG_BufSiz);
+
+    for (n = 0; n < nRules; n++)
+        if (pRules[n].nSearch == 0)
+            Abort("command error, every replace string requires a search string");
+
+    /* display search and replace buffers if any
+     */
+    if (fBuffers)
+    {
+        if (nRules > 1)
+        {
+            for (n = 0; n < nRules; n++)
+            {
+                fputc('\n', Ctrl.fpMsg);
+
+                fprintf(Ctrl.fpMsg, "Rule %u search (ASCII) : ", n + 1);
+                DumpBuffer(pRules[n].Search, pRules[n].nSearch, 0);
+                fprintf(Ctrl.fpMsg, "Length = %3d   (Hex)   : ", pRules[n].nSearch);
+                DumpBuffer(pRules[n].Search, pRules[n].nSearch, 1);
+
+                if (fSearchReplace)
+                {
+                    if (pRules[n].nReplace > 0)
+                    {
+                        fprintf(Ctrl.fpMsg, "Rule %u replace (ASCII): ", n + 1);
+                        DumpBuffer(pRules[n].Replace, pRules[n].nReplace, 0);
+                        fprintf(Ctrl.fpMsg, "Length = %3d   (Hex)   : ", pRules[n].nReplace);
+                        DumpBuffer(pRules[n].Replace, pRules[n].nReplace, 1);
+                    }
+                    else
+                        fprintf(Ctrl.fpMsg, "Note: rule %u deletes its search string!\n", n + 1);
+                }
+            }
+
+            return EXIT_SUCCESS;
+        }
+
+        fputc('\n', Ctrl.fpMsg);
+
+        fprintf(Ctrl.fpMsg, "Search buffer  (ASCII) : ");
+        DumpBuffer(SearchBuf, nItemsSearch, 0);
+        fprintf(Ctrl.fpMsg, "Length = %3d   (Hex)   : ", nItemsSearch);
+        DumpBuffer(SearchBuf, nItemsSearch, 1);
+        fprintf(Ctrl.fpMsg, "\n");
+
+        if (fSearchReplace)
+        {
+            if (nItemsReplace > 0)
+            {
+                fprintf(Ctrl.fpMsg, "Replace buffer (ASCII) : ");
+                DumpBuffer(ReplaceBuf, nItemsReplace, 0);
+                fprintf(Ctrl.fpMsg, "Length = %3d   (Hex)   : ", nItemsReplace);
+                DumpBuffer(ReplaceBuf, nItemsReplace, 1);
+            }
+            else
+                fprintf(Ctrl.fpMsg, "Note: Replace buffer is empty, search string will be removed from file!\n");
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    if (i == 0 && !fFilter && !fServe && nRecurseDirs == 0 && pFileListName == NULL)
+        Abort("command error, no input file name specified");
+
+    if (pFileListName != NULL && (fFilter || nRecurseDirs > 0 || i > 0))
+        Abort("command error, the '@' option cannot be combined with 'F', 'R' or explicit file names");
+
+    if (pFileListName != NULL && fSearchReplace && !fOverWrite)
+        Abort("command error, search & replace with the '@' option requires the 'o' option");
+
+    if (nNameGlobs > 0 && nRecurseDirs == 0)
+        Abort("command error, the 'g' option requires the 'R' option");
+
+    if (nRecurseDirs > 0 && fFilter)
+        Abort("command error, the 'R' option is meaningless in 'filter' mode");
+
+    if (nRecurseDirs > 0 && fSearchReplace && !fOverWrite)
+        Abort("command error, search & replace with the 'R' option requires the 'o' option");
+
+    if (i != 2 && fForce && !fOverWrite)
+        Abort("command error, two file names are required to use the 'f' option");
+
+    if (fUseMmap && (fSearchReplace || fFilter))
+        Abort("command error, the 'M' option is only valid in 'search' mode");
+
+    if (fUseMmap && nRules > 1)
+        Abort("command error, the 'M' option only supports a single search pattern");
+
+    if (fInPlace && (!fSearchReplace || !fOverWrite || fFilter))
+        Abort("command error, the 'I' option requires the 'o' option and a replace string");
+
+    /* the statistics counters are only kept by the single pattern stream
+     * engine and are global, so they cannot be mixed with the modes that
+     * bypass it or run it from several threads
+     */
+    if (BMG_fStats && (nRules > 1 || fUseMmap || fInPlace || fAsyncRead || nWorkers > 1))
+        Abort("command error, the 'S' option is not available with the 'M', 'I', 'A', 'j' or multi pattern modes");
+
+    if (fAsyncRead && (fSearchReplace || fFilter))
+        Abort("command error, the 'A' option is only valid in 'search' mode");
+
+    if ((fQuiet || BMG_MatchLimit != 0) && fSearchReplace)
+        Abort("command error, the 'q' and 'n' options are only valid in 'search' mode");
+
+    if (Ctrl.fRecords && (fSearchReplace || fQuiet))
+        Abort("command error, the 'z' option is only valid in 'search' mode");
+
+    /* serve mode owns stdin and answers one name at a time, so the
+     * other ways of naming input and the modes that drop or reorder
+     * the summary lines are all out
+     */
+    if (fServe && (i > 0 || fFilter || fQuiet || Ctrl.fRecords || pFileListName != NULL || nRecurseDirs > 0 || nWorkers > 1))
+        Abort("command error, the 'D' option cannot be combined with file names or the 'F', 'q', 'z', '@', 'R' or 'j' options");
+
+    if (fServe && fSearchReplace && !fOverWrite)
+        Abort("command error, search & replace with the 'D' option requires the 'o' option");
+
+    if (fSummary && (fFilter || fQuiet))
+        Abort("command error, the 'T' option is not available in 'filter' or quiet mode");
+
+    /* binary records replace the display formats and ride on the match
+     * enumeration of the verbose path
+     */
+    if (pRecName != NULL)
+    {
+        if (fSearchReplace || fFilter || fQuiet || fServe || Ctrl.fRecords)
+            Abort("command error, the 'O' option is only valid in plain 'search' mode");
+
+        Ctrl.pfEmitRec = RecEmit;
+        Ctrl.fVerbose = 1;
+        RecOpen();
+    }
+
+    /* a cached result is a bare match count; it cannot stand in for
+     * context display, records or a truncated scan
+     */
+    if (pCacheName != NULL && (fSearchReplace || fFilter || fQuiet || Ctrl.fVerbose || BMG_MatchLimit != 0))
+        Abort("command error, the 'k' option is only valid in plain 'search' mode");
+
+    if (fTextOnly && (fSearchReplace || fFilter))
+        Abort("command error, the 't' option is only valid in 'search' mode");
+
+    if (fTextOnly && fWideString)
+        Abort("command error, the 't' option cannot be combined with wide character strings");
+
+    /* an existence check needs just the first match and no display */
+    if (fQuiet)
+    {
+        BMG_MatchLimit = 1;
+        Ctrl.fVerbose = 0;
+    }
+
+    if (fAsyncRead && nRules > 1)
+        Abort("command error, the 'A' option only supports a single search pattern");
+
+    SumStart = SumTime();
+
+    if (fProgress)
+    {
+        ProgLast = SumStart;
+        ProgNext = SumStart + (double) nProgSecs;
+        BMG_pfProgress = ProgAdd;
+    }
+
+    if (pCacheName != NULL)
+    {
+        CachePatHash = CachePatternHash();
+        CacheLoad();
+    }
+
+    /* set up the search pattern(s) once and for all
+     */
+    if (nRules > 1)
+        BMG_SetupMulti(pRules, (int) nRules, fFolded);
+    else
+        BMG_Setup(SearchBuf, (int) nItemsSearch, fFolded);
+
+    if (fFilter)
+    {
+        if (fOverWrite || fForce)
+            Abort("command error, the 'o' or 'f' option is meaningless in 'filter' mode");
+
+        if (nWorkers > 1)
+            Abort("command error, the 'j' option is meaningless in 'filter' mode");
+
+        StreamSearchReplace();
+        return (fQuiet && !fFoundMatch) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    /* just perform a file search
+     */
+    if (!fSearchReplace)
+    {
+        if (fOverWrite || fForce)
+            Abort("command error, the 'o' or 'f' option is meaningless in 'search' mode");
+
+        if (fServe)
+        {
+            ServeStdin();
+
+            if (BMG_fStats)
+                BMG_StatsReport(&Ctrl, &BMG_StatsTotal, "total");
+
+            SumReport();
+            CacheSave();
+            RecClose();
+            return EXIT_SUCCESS;
+        }
+
+        if (pFileListName != NULL)
+        {
+            RunFileList();
+
+            if (BMG_fStats)
+                BMG_StatsReport(&Ctrl, &BMG_StatsTotal, "total");
+
+            SumReport();
+            CacheSave();
+            RecClose();
+            return (fQuiet && !fFoundMatch) ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+
+#ifdef __UNIX__
+        if (nRecurseDirs > 0)
+        {
+            Ctrl.fpMsg = stdout;
+            ProducerRun(WalkProducer, NULL);
+
+            SumReport();
+            CacheSave();
+            RecClose();
+            return (fQuiet && !fFoundMatch) ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+
+        /* with mapped input the workers split each file between them
+         * instead, so the file loop itself stays serial
+         */
+        if (nWorkers > 1 && !fUseMmap)
+        {
+            Ctrl.fpMsg = stdout;
+            ParallelRun(i);
+
+            SumReport();
+            CacheSave();
+            RecClose();
+            return (fQuiet && !fFoundMatch) ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+#endif
+        FileSearch();
+
+        if (BMG_fStats)
+            BMG_StatsReport(&Ctrl, &BMG_StatsTotal, "total");
+
+        SumReport();
+        CacheSave();
+        RecClose();
+        return (fQuiet && !fFoundMatch) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    /* Do a search and replace with specific output file
+     */
+    if (i == 2 && !fOverWrite && fSearchReplace)
+    {
+        OneSearchReplace();
+
+        SumReport();
+        return EXIT_SUCCESS;
+    }
+
+    if (!fOverWrite && fSearchReplace)
+        Abort("command error, multiple search & replace requires the 'o' option");
+
+    if (fOverWrite && fSearchReplace)
+    {
+        if (fForce)
+            Abort("command error, the 'f' option is meaningless in multiple search and replace");
+
+        if (fServe)
+        {
+            ServeStdin();
+
+            if (BMG_fStats)
+                BMG_StatsReport(&Ctrl, &BMG_StatsTotal, "total");
+
+            SumReport();
+            CacheSave();
+            RecClose();
+            return EXIT_SUCCESS;
+        }
+
+        if (pFileListName != NULL)
+        {
+            RunFileList();
+
+            if (BMG_fStats)
+                BMG_StatsReport(&Ctrl, &BMG_StatsTotal, "total");
+
+            SumReport();
+            CacheSave();
+            RecClose();
+            return EXIT_SUCCESS;
+        }
+
+#ifdef __UNIX__
+        if (nRecurseDirs > 0)
+        {
+            Ctrl.fpMsg = stdout;
+            ProducerRun(WalkProducer, NULL);
+
+            SumReport();
+            CacheSave();
+            RecClose();
+            return EXIT_SUCCESS;
+        }
+
+        if (nWorkers > 1)
+        {
+            Ctrl.fpMsg = stdout;
+            ParallelRun(i);
+
+            SumReport();
+            CacheSave();
+            RecClose();
+            return EXIT_SUCCESS;
+        }
+#endif
+        SearchReplace();
+
+        if (BMG_fStats)
+            BMG_StatsReport(&Ctrl, &BMG_StatsTotal, "total");
+
+        SumReport();
+    }
+    return EXIT_SUCCESS;
+}
+
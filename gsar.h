@@ -1,65 +1,131 @@
-/* gsar.h
- *
- * Description : Header file for gsar
- * Author      : Tormod Tjaberg
- *
- * Changes:
- *
- * Currently compiles under :
- * Turbo C 2.0, Turbo C++ 1.0, Turbo C++ 3.0, Zortech C++ 3.0,
- * Watcom C 386 8.0, Ultrix ANSI C, Microsoft 6.0, GCC, MinGW
- */
-
-
-/* System type defined upon the following
- * __TURBOC__ : All Borland C/C++ versions
- * __ZTC__    : Zortech/Symantec
- * __DJGPP__  : DJ Delorie's GNU port to the PC
- * __WATCOMC__: Watcom C/C++
- * __MINGW32__: MinGW 32
- * __MINGW64__: MinGW 64
- * MSDOS      : Set by various DOS compilers... ( Watcom 386, Microsoft )
- */
-
-#if defined(__TURBOC__) || defined(__ZTC__) || defined(MSDOS) || defined(__DJGPP__) || defined (__WATCOMC__) || defined (__MINGW32__) || defined (__MINGW64__)
-    #ifndef MSDOS
-        #define MSDOS     5
-    #endif
-#else
-    #ifndef __UNIX__
-        #define __UNIX__  3
-    #endif
-#endif
-
-#ifndef BUFSIZ                            /* ANSI C predefined constant */
-    #ifdef  MSDOS
-        #define BUFSIZ 1024                       /* size of search buffer */
-    #else             /* its __UNIX__ */
-        #define BUFSIZ 4048                       /* size of search buffer */
-    #endif
-#endif
-
-#define TXT_CONTEXT 80      /* length of textual context     */
-#define HEX_CONTEXT 64      /* amount of hex bytes displayed */
-#define PAT_BUFSIZ  256     /* buffer limit < unsigned int */
-
-typedef struct
-{
-    signed char fVerbose;    /* true if we are to be verbose */
-    signed char fByteOffset; /* display byte offset in file */
-    signed char fTextual;    /* display context textual */
-    signed char fFileSpec;   /* display filespec */
-    signed char fHex;        /* display contents in hex */
-    char *pInputFile;        /* current input file name */
-    FILE *fpIn;              /* input stream */
-    FILE *fpOut;             /* output stream */
-    FILE *fpMsg;             /* message stream */
-    unsigned int Context;  /* length of context to display */
-} OUTPUT_CTRL;
-
-/* function prototypes
- */
-void BMG_Setup(char *, int, char);
-long BMG_Search(OUTPUT_CTRL *);
-long BMG_SearchReplace(OUTPUT_CTRL *, char *, unsigned int);
-
+/* gsar.h
+ *
+ * Description : Header file for gsar
+ * Author      : Tormod Tjaberg
+ *
+ * Changes:
+ *
+ * Currently compiles under :
+ * Turbo C 2.0, Turbo C++ 1.0, Turbo C++ 3.0, Zortech C++ 3.0,
+ * Watcom C 386 8.0, Ultrix ANSI C, Microsoft 6.0, GCC, MinGW
+ */
+
+
+/* System type defined upon the following
+ * __TURBOC__ : All Borland C/C++ versions
+ * __ZTC__    : Zortech/Symantec
+ * __DJGPP__  : DJ Delorie's GNU port to the PC
+ * __WATCOMC__: Watcom C/C++
+ * __MINGW32__: MinGW 32
+ * __MINGW64__: MinGW 64
+ * MSDOS      : Set by various DOS compilers... ( Watcom 386, Microsoft )
+ */
+
+#if defined(__TURBOC__) || defined(__ZTC__) || defined(MSDOS) || defined(__DJGPP__) || defined (__WATCOMC__) || defined (__MINGW32__) || defined (__MINGW64__)
+    #ifndef MSDOS
+        #define MSDOS     5
+    #endif
+#else
+    #ifndef __UNIX__
+        #define __UNIX__  3
+    #endif
+#endif
+
+#ifndef BUFSIZ                            /* ANSI C predefined constant */
+    #ifdef  MSDOS
+        #define BUFSIZ 1024                       /* size of search buffer */
+    #else             /* its __UNIX__ */
+        #define BUFSIZ 4048                       /* size of search buffer */
+    #endif
+#endif
+
+#define TXT_CONTEXT 80      /* length of textual context     */
+#define HEX_CONTEXT 64      /* amount of hex bytes displayed */
+#define PAT_BUFSIZ  256     /* longest directly scanned pattern; longer
+                             * patterns are found through an anchor */
+
+/* One search & replace pair for the multi pattern engine
+ */
+typedef struct
+{
+    char *Search;              /* pattern to search for, allocated to fit */
+    char *Replace;             /* replacement text, allocated to fit */
+    unsigned int nSearch;      /* length of search pattern */
+    unsigned int nReplace;     /* length of replacement */
+    signed char  fReplace;     /* a replace side was given for this rule */
+} GSAR_RULE;
+
+typedef struct output_ctrl
+{
+    signed char fVerbose;    /* true if we are to be verbose */
+    signed char fByteOffset; /* display byte offset in file */
+    signed char fTextual;    /* display context textual */
+    signed char fFileSpec;   /* display filespec */
+    signed char fHex;        /* display contents in hex */
+    signed char fRecords;    /* emit NUL delimited match records */
+    char *pInputFile;        /* current input file name */
+    FILE *fpIn;              /* input stream */
+    FILE *fpOut;             /* output stream */
+    FILE *fpMsg;             /* message stream */
+    unsigned int Context;  /* length of context to display */
+    unsigned char *pBuffer;  /* per context search buffer, NULL selects
+                              * the built-in static buffer */
+    char *pFmtBuf;           /* match record format buffer, allocated on
+                              * the first match */
+    long FmtSiz;             /* size of the format buffer */
+    char *pOutName;          /* name of the lazily created output file,
+                              * NULL while none exists */
+    FILE *(*pfOpenOut)(struct output_ctrl *);  /* called by the engine on
+                              * the first match when fpOut is NULL, so no
+                              * output file is created for files without
+                              * matches */
+    void (*pfEmitRec)(struct output_ctrl *, unsigned long long);  /* when
+                              * set, called per match with the byte offset
+                              * instead of rendering the display format */
+    char *pRecFile;          /* file whose record id is cached */
+    int   RecId;             /* cached record file id */
+} OUTPUT_CTRL;
+
+/* Performance counters collected by BMG_Search and BMG_SearchReplace
+ * when BMG_fStats is set. Updated per buffer refill and per candidate
+ * verification, never inside the skip loop itself, so the instrumented
+ * path costs next to nothing.
+ */
+typedef struct
+{
+    unsigned long long nBytes;   /* bytes handed to the scan loop */
+    unsigned long nRefills;      /* buffer refills */
+    unsigned long nCandidates;   /* candidate verifications */
+    unsigned long nMatches;      /* confirmed matches */
+    double IoTime;               /* seconds spent in fread/fwrite */
+    double ScanTime;             /* seconds spent scanning */
+} BMG_STATS;
+
+/* function prototypes
+ */
+extern long BMG_BufSiz;       /* runtime size of the search buffer */
+extern long BMG_MatchLimit;   /* per file match limit, 0 searches all */
+extern int  BMG_fStats;       /* collect statistics while searching */
+extern BMG_STATS BMG_Stats;      /* counters for the current file */
+extern BMG_STATS BMG_StatsTotal; /* aggregate over all files */
+extern void (*BMG_pfProgress)(unsigned long long);  /* when set, called
+                                 * once per buffer refill with the bytes
+                                 * just read */
+
+void BMG_Setup(char *, int, char);
+void BMG_SetBufSiz(long);
+unsigned char *BMG_AllocBuffer(void);
+long BMG_Search(OUTPUT_CTRL *);
+#ifdef __UNIX__
+long BMG_SearchAsync(OUTPUT_CTRL *);
+#endif
+long BMG_SearchMem(OUTPUT_CTRL *, unsigned char *, unsigned long long,
+                   unsigned long long);
+long BMG_SearchReplace(OUTPUT_CTRL *, char *, unsigned int);
+long BMG_ReplaceInPlace(OUTPUT_CTRL *, char *, unsigned int);
+void BMG_StatsFold(void);
+void BMG_StatsReport(OUTPUT_CTRL *, BMG_STATS *, const char *);
+void BMG_SetupMulti(GSAR_RULE *, int, char);
+long BMG_MultiSearch(OUTPUT_CTRL *);
+long BMG_MultiSearchReplace(OUTPUT_CTRL *);
+
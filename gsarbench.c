@@ -0,0 +1,305 @@
+/* gsarbench.c
+ *
+ * Description : Throughput benchmark for the gsar search engine
+ * Author      : Tormod Tjaberg & Hans Peter Verne
+ *
+ * Copyright (C) 1992-2020 Tormod Tjaberg & Hans Peter Verne,
+ * This is free software, distributed under the terms of the
+ * GNU General Public License. For details see the file COPYING
+ *
+ * Times BMG_Search(), BMG_SearchMem() and BMG_SearchReplace() over a
+ * synthetic corpus with varying pattern length, alphabet density and
+ * match frequency, and reports MB/s and matches/s together with the
+ * spread over the repeat runs. Run it before and after an engine
+ * change to see whether the change helped or hurt.
+ *
+ * Build : cc -O2 -o gsarbench gsarbench.c gsarbmg.c arg_func.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include "comp_dep.h"
+#include "arg_func.h"
+#include "gsar.h"
+
+#ifdef MSDOS
+    #define NULL_FILE "NUL"
+#else
+    #define NULL_FILE "/dev/null"
+#endif
+
+#define DEF_CORPUS   (16L * 1024L * 1024L)  /* default corpus size */
+#define DEF_REPEAT   3                      /* default runs per scenario */
+#define MAX_REPEAT   32
+
+/* One benchmark scenario
+ */
+typedef struct
+{
+    int  PatLen;      /* length of the search pattern */
+    int  nAlpha;      /* number of distinct byte values in the corpus */
+    long MatchGap;    /* plant a match every MatchGap bytes, 0 for none */
+} BENCH_CASE;
+
+static BENCH_CASE Cases[] =
+{
+    {  3,   4,    0 }, {  3,  64,    0 }, {  3, 250,    0 },
+    {  8,   4,    0 }, {  8,  64,    0 }, {  8, 250,    0 },
+    { 32,   4,    0 }, { 32,  64,    0 }, { 32, 250,    0 },
+    { 96,  64,    0 }, { 96, 250,    0 },
+    {  8,  64, 8192 }, { 32,  64, 8192 }, {  8, 250, 65536 },
+};
+
+static long CorpusSiz = DEF_CORPUS;
+static int  nRepeat = DEF_REPEAT;
+
+OUTPUT_CTRL Ctrl;
+
+/* Input  : Message to be displayed with the format of standard printf
+ * Returns: Nothing, but instead it exits to operating system
+ *
+ * The engine calls Abort() on fatal errors, so the benchmark has to
+ * provide one just like the main program does.
+ */
+void Abort(const char *pMessage, ...)
+{
+    va_list argp;
+
+    fprintf(stderr, "gsarbench: ");
+    va_start(argp, pMessage);
+    vfprintf(stderr, pMessage, argp);
+    va_end(argp);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+
+/* Returns the current time in seconds as a double. Resolution has to
+ * be well below a millisecond for the numbers to mean anything.
+ */
+static double Now(void)
+{
+#ifdef __UNIX__
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#else
+    return (double) clock() / (double) CLOCKS_PER_SEC;
+#endif
+}
+
+
+/* Input  : pCase - scenario to generate for
+ *          pPat  - receives the search pattern
+ *          pBuf  - corpus buffer of CorpusSiz bytes
+ *
+ * Fills the corpus with bytes drawn from the scenario's alphabet and
+ * plants the pattern at the requested interval. The pattern itself is
+ * drawn from the same alphabet so the delta table sees realistic skip
+ * distances.
+ */
+static void MakeCorpus(BENCH_CASE *pCase, char *pPat, unsigned char *pBuf)
+{
+    long i;
+
+    srand(4711 + pCase->PatLen * 131 + pCase->nAlpha);
+
+    for (i = 0; i < pCase->PatLen; i++)
+        pPat[i] = (char) (rand() % pCase->nAlpha);
+
+    for (i = 0; i < CorpusSiz; i++)
+        pBuf[i] = (unsigned char) (rand() % pCase->nAlpha);
+
+    if (pCase->MatchGap > 0)
+        for (i = pCase->MatchGap; i + pCase->PatLen <= CorpusSiz; i += pCase->MatchGap)
+            memcpy(pBuf + i, pPat, pCase->PatLen);
+}
+
+
+/* Input  : pTimes - seconds per run, nRepeat entries
+ * Returns: spread of the runs as a percentage of the best run
+ */
+static double Spread(double *pTimes)
+{
+    double Min = pTimes[0];
+    double Max = pTimes[0];
+    int i;
+
+    for (i = 1; i < nRepeat; i++)
+    {
+        if (pTimes[i] < Min)
+            Min = pTimes[i];
+        if (pTimes[i] > Max)
+            Max = pTimes[i];
+    }
+
+    return (Max - Min) * 100.0 / Min;
+}
+
+
+/* Input  : pTimes - seconds per run, nRepeat entries
+ * Returns: the best run in seconds
+ */
+static double Best(double *pTimes)
+{
+    double Min = pTimes[0];
+    int i;
+
+    for (i = 1; i < nRepeat; i++)
+        if (pTimes[i] < Min)
+            Min = pTimes[i];
+
+    return Min;
+}
+
+
+/* Runs one scenario: engine-only over memory, end to end over a file,
+ * and search & replace to the null device, and prints one result line.
+ */
+static void RunCase(BENCH_CASE *pCase, unsigned char *pBuf, const char *pTmpFile)
+{
+    char    Pattern[PAT_BUFSIZ];
+    char    Replace[PAT_BUFSIZ];
+    double  MemTimes[MAX_REPEAT] = { 0.0 };
+    double  FileTimes[MAX_REPEAT] = { 0.0 };
+    double  ReplTimes[MAX_REPEAT] = { 0.0 };
+    double  t, Mb;
+    long    nMatches = 0;
+    FILE   *fp;
+    int     Run;
+
+    MakeCorpus(pCase, Pattern, pBuf);
+    BMG_Setup(Pattern, pCase->PatLen, 0);
+
+    /* engine only, no file I/O in the timed region
+     */
+    for (Run = 0; Run < nRepeat; Run++)
+    {
+        t = Now();
+        nMatches = BMG_SearchMem(&Ctrl, pBuf, (unsigned long long) CorpusSiz, 0);
+        MemTimes[Run] = Now() - t;
+    }
+
+    /* end to end through the stream reader
+     */
+    if ((fp = fopen(pTmpFile, "wb")) == NULL)
+        Abort("error, unable to create corpus file '%s'", pTmpFile);
+    if (fwrite(pBuf, 1, (size_t) CorpusSiz, fp) != (size_t) CorpusSiz)
+        Abort("error, unable to write corpus file '%s'", pTmpFile);
+    fclose(fp);
+
+    for (Run = 0; Run < nRepeat; Run++)
+    {
+        if ((Ctrl.fpIn = fopen(pTmpFile, "rb")) == NULL)
+            Abort("error, unable to open corpus file '%s'", pTmpFile);
+        t = Now();
+        BMG_Search(&Ctrl);
+        FileTimes[Run] = Now() - t;
+        fclose(Ctrl.fpIn);
+    }
+
+    /* search & replace with a same length replacement, output to the
+     * null device so we time the engine and the reader, not the disk
+     */
+    memcpy(Replace, Pattern, pCase->PatLen);
+    Replace[0] = (char) ~Replace[0];
+
+    for (Run = 0; Run < nRepeat; Run++)
+    {
+        if ((Ctrl.fpIn = fopen(pTmpFile, "rb")) == NULL)
+            Abort("error, unable to open corpus file '%s'", pTmpFile);
+        if ((Ctrl.fpOut = fopen(NULL_FILE, "wb")) == NULL)
+            Abort("error, unable to open '%s'", NULL_FILE);
+        t = Now();
+        BMG_SearchReplace(&Ctrl, Replace, (unsigned int) pCase->PatLen);
+        ReplTimes[Run] = Now() - t;
+        fclose(Ctrl.fpIn);
+        fclose(Ctrl.fpOut);
+    }
+
+    remove(pTmpFile);
+
+    Mb = (double) CorpusSiz / (1024.0 * 1024.0);
+    printf("pat %3d  alpha %3d  gap %6ld  matches %7ld | mem %8.1f  file %8.1f  repl %8.1f MB/s | spread %4.1f%%\n",
+           pCase->PatLen, pCase->nAlpha, pCase->MatchGap, nMatches,
+           Mb / Best(MemTimes), Mb / Best(FileTimes), Mb / Best(ReplTimes),
+           Spread(MemTimes));
+
+    if (nMatches > 0)
+        printf("%62s %10.0f matches/s\n", "",
+               (double) nMatches / Best(MemTimes));
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned char *pBuf;
+    char *pEnd;
+    long  longVal;
+    int   c;
+    unsigned int i;
+    const char OptStr[] = "z:n:";
+
+    while ((c = GetOpt(argc, argv, OptStr)) != EOF)
+    {
+        switch (c)
+        {
+            case 'z':
+                longVal = strtol(pOptArg, &pEnd, 0);
+
+                switch (*pEnd)
+                {
+                    case 'g':
+                        longVal *= 1024;
+                        /* fall through */
+                    case 'm':
+                        longVal *= 1024;
+                        /* fall through */
+                    case 'k':
+                        longVal *= 1024;
+                        pEnd++;
+                        break;
+                    default:
+                        break;
+                }
+
+                if (pEnd == pOptArg || *pEnd != '\0' || longVal < 4096)
+                    Abort("command error, invalid corpus size : %s", pOptArg);
+
+                CorpusSiz = longVal;
+                break;
+            case 'n':
+                longVal = strtol(pOptArg, &pEnd, 0);
+                if (*pEnd != '\0' || longVal < 1 || longVal > MAX_REPEAT)
+                    Abort("command error, repeats must be in the range 1 to %d", MAX_REPEAT);
+                nRepeat = (int) longVal;
+                break;
+            case MISSING_ARG:
+                Abort("command error, the '%c' option requires an argument", (unsigned char) CurOpt);
+                break;
+            default:
+                Abort("usage: gsarbench [-z<corpus size>] [-n<repeats>]");
+                break;
+        }
+    }
+
+    if ((pBuf = (unsigned char *) malloc((size_t) CorpusSiz)) == NULL)
+        Abort("error, unable to allocate %ld byte corpus", CorpusSiz);
+
+    Ctrl.fVerbose = 0;
+    Ctrl.fFileSpec = 0;
+    Ctrl.fpMsg = stderr;
+    Ctrl.pInputFile = "corpus";
+
+    printf("gsarbench: %ld byte corpus, best of %d runs, search buffer %ld bytes\n",
+           CorpusSiz, nRepeat, BMG_BufSiz);
+
+    for (i = 0; i < sizeof(Cases) / sizeof(Cases[0]); i++)
+        RunCase(&Cases[i], pBuf, "gsarbench.tmp");
+
+    free(pBuf);
+    return EXIT_SUCCESS;
+}
@@ -1,456 +1,2104 @@
-/* gsarbmg.c
- *
- * Subroutines for fast string searching; no regular expressions
- *
- * Adapted from:
- *
- * Boyer/Moore/Gosper-assisted 'egrep' search, with delta0 table as in
- * original paper (CACM, October, 1977).  No delta1 or delta2.  According to
- * experiment (Horspool, Soft. Prac. Exp., 1982), delta2 is of minimal
- * practical value.  However, to improve for worst case input, integrating
- * the improved Galil strategies (Apostolico/Giancarlo, Siam. J. Comput.,
- * February 1986) deserves consideration.
- *
- * James A. Woods
- * NASA Ames Research Center
- *
- * 29 April 1986 Jeff Mogul Stanford
- * Adapted as a set of subroutines for use by a program. No
- * regular-expression support.
- *
- * 12 February 1992 Tormod Tjaberg
- * Used parts of the original routines to implement extremely fast
- * file search & replace mechanisms on ASCII & non ASCII files taking
- * care not to 'chop' up the search pattern.
- *
- * Note:
- * If a file consists of the following bytes: 'abrabra' a search for
- * 'abra' will yield two matches. However if we are to replace 'abra'
- * with 'foobar' only one occurrence will be changed and the output
- * file will contain 'foobarbra'.
- *
- * Copyright (C) 1992-2020 Tormod Tjaberg
- * This is free software, distributed under the terms of the
- * GNU General Public License. For details see the file COPYING
- */
-
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-#include <ctype.h>
-#include <sys/types.h>
-#include "comp_dep.h"
-#include "gsar.h"
-
-#undef  BUFSIZ
-#define BUFSIZ  4096
-#define LARGE   32767      /* overshoot, LARGE > (BUFSIZ + PAT_BUFSIZ) */
-
-/* Variables needed to perform the BMG search.
- */
-int            BMG_Patlen;                        /* length of pattern */
-unsigned char  BMG_Pattern[PAT_BUFSIZ];           /* actual pattern */
-int            BMG_Delta0[256];                   /* ascii only */
-unsigned char  BMG_Buffer[BUFSIZ + PAT_BUFSIZ];   /* search buffer */
-unsigned char  BMG_Cmap[256];
-
-/* Input  : pCtrl - pointer to structure containg output and ctrl info
- *          FileOfs - actual offset in file
- *          BufOfs - match offset in search buffer
- *          pStart - pointer to start of the search buffer
- *          pEnd - pointer to end of the search buffer
- *
- * Returns: nothing
- *
- * Displays buffer information (filename, offset, context) according
- * to the flags set in the structure. i.e. be a bit verbose.
- */
-static void Verbose(OUTPUT_CTRL *pCtrl, unsigned long long FileOfs, int BufOfs,
-             unsigned char *pStart, unsigned char *pEnd)
-{
-    unsigned char *pSC;        /* start of context */
-    unsigned char *pEC;        /* end of context */
-    unsigned char *pLastSC;    /* last start of context */
-
-    unsigned long long CtxOfs; /* context offset */
-
-    int i;                     /* loop counter */
-
-    if (pCtrl->fFileSpec) 
-    { /* display file name */
-        fprintf(pCtrl->fpMsg, "%s: ", pCtrl->pInputFile);
-    }
-
-    if (pCtrl->fByteOffset)              /* display byte offset */
-    {
-#ifdef MSDOS
-        fprintf(pCtrl->fpMsg, "0x%I64x%s", FileOfs + BufOfs, (pCtrl->fTextual) ? ": " : "");
-#else
-        fprintf(pCtrl->fpMsg, "0x%llx%s",  FileOfs + BufOfs, (pCtrl->fTextual) ? ": " : "");
-#endif
-    }
-
-    /* Display a textual or a hexadecimal context
-     */
-    if (pCtrl->fTextual || pCtrl->fHex)
-    {
-        pSC = pStart + BufOfs - pCtrl->Context / 2 + BMG_Patlen / 2;
-        if (pSC < pStart)                /* outside the buffer ? */
-            pSC = pStart;
-
-        pEC = pSC + pCtrl->Context;
-        if (pEC > pEnd)                  /* outside the buffer ? */
-        {
-            pEC = pEnd;
-
-            /* if we have to truncate to pEnd readjust the start
-             * of the context if possible.
-             */
-            if (pEC - pCtrl->Context > pStart)
-                pSC = pEC - pCtrl->Context;
-        }
-
-        /* display a hexadecimal context
-         */
-        if (pCtrl->fHex)
-        {
-            fputc('\n', pCtrl->fpMsg);
-
-            CtxOfs = FileOfs + (pSC - pStart);
-
-            while (pSC != pEC)
-            {
-                pLastSC = pSC;                /* remember where we started */
-
-#ifdef MSDOS
-                fprintf(pCtrl->fpMsg, "0x%0I64x: ", CtxOfs); /* hex offset */
-#else
-                fprintf(pCtrl->fpMsg, "0x%0llx: ", CtxOfs); /* hex offset */
-#endif
-
-                for (i = 0; i < 16; i++)        /* display 16 hex digits */
-                {
-                    if (pSC != pEC)
-                        fprintf(pCtrl->fpMsg, "%02x ", (unsigned char) * pSC++);
-                    else
-                        fprintf(pCtrl->fpMsg, "   ");
-                }
-
-                pSC = pLastSC;                             /* start again */
-
-                for (i = 0; i < 16; i++)       /* display 16 characters */
-                {
-                    if (pSC != pEC)
-                    {
-#ifdef MSDOS      /* MSDOS can display all characters except CTRL chars */
-                        if (!iscntrl((int) * pSC))
-#else             /* its __UNIX__ */
-                        if (isprint((int) * pSC))
-#endif
-                            fputc(*pSC, pCtrl->fpMsg);
-                        else
-                            fputc('.', pCtrl->fpMsg);
-
-                        pSC++;
-                    }
-                }
-                CtxOfs += 16;             /* increment context offset by 16 */
-                fputc('\n', pCtrl->fpMsg);
-            }
-
-        }
-
-        /* display textual context...
-         */
-        if (pCtrl->fTextual)
-        {
-            while (pSC != pEC)
-            {
-#ifdef MSDOS   /* MSDOS can display all characters except CTRL chars */
-                if (!iscntrl((int) * pSC))
-#else          /* its __UNIX__ */
-                if (isprint((int) * pSC))
-#endif
-                    fputc(*pSC, pCtrl->fpMsg);
-                else
-                    fputc('.', pCtrl->fpMsg);
-
-                pSC++;
-            }
-        }
-    }
-
-    if (!pCtrl->fHex)
-        fputc('\n', pCtrl->fpMsg);
-}
-
-
-/* The algorithm requires a test against an address outside the buffer */
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Warray-bounds"
-
-/* Input    : pCtrl - pointer to structure containg output and ctrl info
- * Returns  : number of matches found in file
- *
- * The pattern to search for must already have been set up using BMG_Setup
- *
- * Works by applying the BMG algorithm to a buffer. To ensure the pattern
- * is not inadvertently chopped up, BMG_Patlen - 1 bytes is always moved
- * to the start of the buffer. The next time we fill the buffer we fill it
- * with BUFSIZ - (BMG_Patlen - 1) bytes.
- */
-long BMG_Search(OUTPUT_CTRL *pCtrl)
-{
-    register unsigned char *k;
-    register unsigned char *s;
-    register unsigned char *strend;
-
-    register int j;
-
-    int  nTrans = 0;   /* number of bytes to transfer to the start of the buffer */
-    int  BufOfs;       /* buffer offset for each match */
-    int  Cnt = BUFSIZ;
-
-    long nMatches = 0;                  /* number of matches found */
-    long nBytes;                        /* number of bytes read */
-    unsigned long long FileOfs = 0;     /* current file offset */
-
-    for (;;)
-    {
-        nBytes = fread(&BMG_Buffer[nTrans], 1, (size_t) Cnt, pCtrl->fpIn);
-
-        if (!nBytes)
-            break;
-
-        s = BMG_Buffer;
-
-        strend = s + nBytes + nTrans;
-
-        k = BMG_Buffer + BMG_Patlen - 1;
-
-        for (;;)
-        {
-            while ((k += BMG_Delta0[*(unsigned char *) k]) < strend)
-                ;
-
-            if (k < (BMG_Buffer + LARGE))
-                break;
-            k -= LARGE;
-
-            j = BMG_Patlen - 1;
-            s = k - 1;
-
-            while (BMG_Cmap[*s--] == BMG_Pattern[--j])
-                ;
-            if (j >= 0)
-                k++;
-            else
-            {
-                if (k >= strend)
-                    break;
-
-                /* found submatch, k is on the last letter in the match */
-                BufOfs = k - BMG_Buffer + 1 - BMG_Patlen;
-
-                nMatches++;
-                if (pCtrl->fVerbose)
-                    Verbose(pCtrl, FileOfs, BufOfs, BMG_Buffer, strend);
-
-                k++;
-            }
-        }
-
-        nTrans = BMG_Patlen - 1;
-
-        memcpy(BMG_Buffer, strend - nTrans, nTrans); /* move remaining bytes to the start */
-        Cnt = BUFSIZ - nTrans;
-        FileOfs += Cnt;                              /* calculate file offset  */
-    }
-
-    return nMatches;
-}
-
-
-/* Input    : pCtrl - pointer to structure containg output and ctrl info
- *            ReplaceBuf - pointer to buffer which contains replacement
- *            nReplace - number of bytes in replace buffer
- *
- * Returns  : number of matches & replaces performed
- *            -1 if error in fwrite, disk might be full, or removed
- *
- * The pattern to search for must already have been set up using BMG_Setup
- *
- * Works by applying the BMG algorithm to a buffer. To ensure the pattern
- * is not inadvertently chopped up we have to be a little careful. Since
- * we're doing a search and replace we can't copy BMG_Patlen - 1 bytes
- * always. Consider the following:
- *
- * We're searching for 'aa' in the string 'aaaa'
- * This will give a result of 3 matches namely: a[0]a[1] a[1]a[2] a[2]a[3]
- *
- * But if we're searching for 'aa' and replacing with 'xx' in 'aaaa'
- * This will give a result of 2 matches and the new buffer:   'xxxx'
- * After a match of a[0]a[1] we must start the next search at a[2].
- *
- * So if we have a match at the exact end of the buffer. We must
- * not transfer anything to the start.
- *
- * Use the following algorithm:
- *
- * Calculate the distance between the last match and the end of the buffer
- * and call this distance n.
- *
- * n = end of buffer - last match
- * if n >= Bmg_Patlen we transfer BMG_Patlen - 1 bytes to the start
- * if n < Bmg_Patlen we transfer n bytes to the start of the buffer
- */
-long BMG_SearchReplace(OUTPUT_CTRL *pCtrl, char *pReplaceBuf, unsigned int nReplace)
-{
-    register unsigned char *k;
-    register unsigned char *s;
-    register unsigned char *strend;
-
-    register int j;
-    register int n;
-    unsigned char *pLast;
-
-    int  nTrans = 0;   /* number of bytes to transfer to the start of the buffer */
-    int  BufOfs;       /* buffer offset for each match */
-    int  Cnt = BUFSIZ;
-
-    long nMatches = 0;                       /* number of matches found */
-    long nBytes;                             /* number of bytes read */
-    unsigned long long FileOfs = 0;          /* current file offset */
-
-    for (;;)
-    {
-        nBytes = (unsigned long) fread(&BMG_Buffer[nTrans], sizeof(unsigned char), (size_t) Cnt, pCtrl->fpIn);
-
-        if (!nBytes)
-        {
-            if (fwrite(BMG_Buffer, sizeof(unsigned char), nTrans, pCtrl->fpOut) != nTrans)
-                return -1;
-            break;
-        }
-
-        s = BMG_Buffer;
-        pLast = s;
-
-        strend = s + nBytes + nTrans;
-
-        k = BMG_Buffer + BMG_Patlen - 1;
-
-        for (;;)
-        {
-            while ((k += BMG_Delta0[*(unsigned char *) k]) < strend)
-                ;
-
-            if (k < (BMG_Buffer + LARGE))
-                break;
-            k -= LARGE;
-
-            j = BMG_Patlen - 1;
-            s = k - 1;
-
-            while (BMG_Cmap[*s--] == BMG_Pattern[--j])
-                ;
-            if (j >= 0)
-                k++;
-            else
-            {
-                if (k >= strend)
-                    break;
-
-                /* found submatch, k is on the last letter in the match */
-                BufOfs = k - BMG_Buffer + 1 - BMG_Patlen;
-
-                n = (BMG_Buffer + BufOfs) - pLast;
-                k++;
-
-                if (n >= 0)
-                {
-                    nMatches++;
-
-                    if (pCtrl->fVerbose)
-                        Verbose(pCtrl, FileOfs, BufOfs, BMG_Buffer, strend);
-
-                    if (fwrite(pLast, sizeof(unsigned char), n, pCtrl->fpOut) != n)
-                        return -1;
-
-                    if (fwrite(pReplaceBuf, sizeof(unsigned char), nReplace, pCtrl->fpOut) != nReplace)
-                        return -1;
-
-                    pLast = k;      /* set last marker to write from */
-                }
-            }
-        }
-
-        n = strend - pLast;
-
-        if (n >= BMG_Patlen)
-        {
-            fwrite(pLast, sizeof(unsigned char), n - BMG_Patlen + 1, pCtrl->fpOut);
-            nTrans = BMG_Patlen - 1;
-        }
-        else
-        {
-            nTrans = n;
-        }
-
-        memcpy(BMG_Buffer, strend - nTrans, nTrans); /* move remaining bytes to the start */
-
-        Cnt = BUFSIZ - nTrans;
-        FileOfs += Cnt;  /* calculate file offset  */
-    }
-
-    return nMatches;
-}
-
-#pragma GCC diagnostic pop
-
-
-/* Input    : pat - pointer to pattern string
- *            PatLen - actual length of the pattern
- *            fFolded - flag which determines case folding
- * Returns  : nothing
- *
- * Set up & compute Boyer-Moore delta (jump) table
- */
-void BMG_Setup(char *pat, int PatLen, char fFolded)
-{
-    register int j;
-
-    BMG_Patlen = PatLen;
-
-    if (fFolded)
-    {
-        /* fold case while saving pattern */
-        for (j = 0; j < BMG_Patlen; j++)
-            BMG_Pattern[j] = (isupper((int) pat[j])
-                              ? (unsigned char) tolower((int) pat[j]) : pat[j]);
-    }
-    else
-        memcpy(BMG_Pattern, (unsigned char *) pat, BMG_Patlen);
-
-    for (j = 0; j < 256; j++)
-    {
-        BMG_Delta0[j] = BMG_Patlen;
-        BMG_Cmap[j] = (unsigned char) j; /* could be done at compile time */
-    }
-
-    for (j = 0; j < BMG_Patlen - 1; j++)
-        BMG_Delta0[BMG_Pattern[j]] = BMG_Patlen - j - 1;
-
-    BMG_Delta0[BMG_Pattern[BMG_Patlen - 1]] = LARGE;
-
-    if (fFolded)
-    {
-        for (j = 0; j < BMG_Patlen - 1; j++)
-            if (islower((int) BMG_Pattern[j]))
-                BMG_Delta0[toupper((int) BMG_Pattern[j])] = BMG_Patlen - j - 1;
-        if (islower((int) BMG_Pattern[BMG_Patlen - 1]))
-            BMG_Delta0[toupper((int) BMG_Pattern[BMG_Patlen - 1])] = LARGE;
-        for (j = 'A'; j <= 'Z'; j++)
-            BMG_Cmap[j] = (unsigned char) tolower((int) j);
-    }
-}
+/* gsarbmg.c
+ *
+ * Subroutines for fast string searching; no regular expressions
+ *
+ * Adapted from:
+ *
+ * Boyer/Moore/Gosper-assisted 'egrep' search, with delta0 table as in
+ * original paper (CACM, October, 1977).  No delta1 or delta2.  According to
+ * experiment (Horspool, Soft. Prac. Exp., 1982), delta2 is of minimal
+ * practical value.  However, to improve for worst case input, integrating
+ * the improved Galil strategies (Apostolico/Giancarlo, Siam. J. Comput.,
+ * February 1986) deserves consideration.
+ *
+ * James A. Woods
+ * NASA Ames Research Center
+ *
+ * 29 April 1986 Jeff Mogul Stanford
+ * Adapted as a set of subroutines for use by a program. No
+ * regular-expression support.
+ *
+ * 12 February 1992 Tormod Tjaberg
+ * Used parts of the original routines to implement extremely fast
+ * file search & replace mechanisms on ASCII & non ASCII files taking
+ * care not to 'chop' up the search pattern.
+ *
+ * Note:
+ * If a file consists of the following bytes: 'abrabra' a search for
+ * 'abra' will yield two matches. However if we are to replace 'abra'
+ * with 'foobar' only one occurrence will be changed and the output
+ * file will contain 'foobarbra'.
+ *
+ * Copyright (C) 1992-2020 Tormod Tjaberg
+ * This is free software, distributed under the terms of the
+ * GNU General Public License. For details see the file COPYING
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/types.h>
+#include "comp_dep.h"
+#include "arg_func.h"
+#include "gsar.h"
+
+#ifdef __UNIX__
+    #include <pthread.h>
+#endif
+
+#undef  BUFSIZ
+
+/* Default size of the search buffer; can be overridden at runtime
+ * through BMG_SetBufSiz before the pattern is set up
+ */
+#ifdef MSDOS
+    #define DEF_BUFSIZ  4096        /* small machines, small buffer */
+#else
+    #define DEF_BUFSIZ  0x100000    /* 1 MB */
+#endif
+
+/* The vector scan kernel needs GCC style intrinsics and builtins and is
+ * only worth carrying on machines where SSE2 is part of the baseline
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+    #define GSAR_SIMD 1
+    #include <immintrin.h>
+#endif
+
+/* Variables needed to perform the BMG search.
+ *
+ * Patterns up to PAT_BUFSIZ bytes are scanned whole. Longer patterns
+ * are found through an anchor: the delta tables are built over a
+ * PAT_BUFSIZ byte window of the pattern and every anchor hit is
+ * verified against the full pattern, so the skip distance stays at its
+ * cap instead of the table growing with the pattern. BMG_Pattern then
+ * points at the window inside BMG_FullPat.
+ */
+int            BMG_Patlen;                        /* length of scanned pattern */
+unsigned char *BMG_Pattern;                       /* scanned pattern, points
+                                                   * into the full pattern */
+int            BMG_Delta0[256];                   /* ascii only */
+unsigned char  BMG_Cmap[256];
+static unsigned char *BMG_FullPat;                /* the full pattern */
+static int     BMG_FullLen;                       /* its length */
+static int     BMG_AnchorOfs;                     /* offset of the scanned
+                                                   * window, 0 unless anchored */
+static int     BMG_fAnchored;                     /* pattern longer than
+                                                   * PAT_BUFSIZ */
+static int     BMG_Period;                        /* smallest period when the
+                                                   * pattern is periodic, else 0 */
+static int     BMG_fExact;                        /* no case folding, verify
+                                                   * candidates with memcmp */
+
+long           BMG_BufSiz = DEF_BUFSIZ;           /* runtime buffer size */
+long           BMG_MatchLimit = 0;                /* stop a file after this
+                                                   * many matches, 0 = all */
+static long    BMG_Large  = DEF_BUFSIZ + PAT_BUFSIZ + 1;  /* overshoot,
+                                * BMG_Large > (BMG_BufSiz + PAT_BUFSIZ) */
+static unsigned char *BMG_Buffer;                 /* default search buffer,
+                                                   * allocated at setup */
+
+/* Input    : Size - requested search buffer size in bytes
+ * Returns  : nothing
+ *
+ * Must be called before BMG_Setup / BMG_SetupMulti since the overshoot
+ * constant baked into the delta table is derived from the buffer size.
+ */
+void BMG_SetBufSiz(long Size)
+{
+    BMG_BufSiz = Size;
+    BMG_Large = Size + PAT_BUFSIZ + 1;
+}
+
+/* Returns  : pointer to a malloc'd search buffer, NULL if out of memory
+ *
+ * The pattern tables set up by BMG_Setup are read-only while searching
+ * and can be shared, but the search buffer is scribbled on. A caller
+ * that runs the engine from several threads must give each OUTPUT_CTRL
+ * its own buffer through the pBuffer member; this returns one of the
+ * right size.
+ */
+unsigned char *BMG_AllocBuffer(void)
+{
+    return (unsigned char *) malloc((size_t) (BMG_BufSiz + PAT_BUFSIZ));
+}
+
+/* Statistics for the 'S' option. The search functions account for their
+ * time in two buckets, I/O and scanning, by closing the bucket that was
+ * open whenever they cross from one kind of work into the other.
+ */
+int BMG_fStats = 0;
+BMG_STATS BMG_Stats;
+BMG_STATS BMG_StatsTotal;
+
+/* Progress hook for the 'P' option. When set, the streaming search
+ * functions call it once per buffer refill with the bytes just read,
+ * never from inside the skip loop, so a reported run scans at full
+ * speed.
+ */
+void (*BMG_pfProgress)(unsigned long long) = NULL;
+
+/* Returns  : the current time in seconds as a double
+ */
+static double StatTime(void)
+{
+#ifdef __UNIX__
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#else
+    return (double) clock() / (double) CLOCKS_PER_SEC;
+#endif
+}
+
+/* Adds the per file counters to the aggregate and clears them, to be
+ * called once the per file figures have been reported.
+ */
+void BMG_StatsFold(void)
+{
+    BMG_StatsTotal.nBytes += BMG_Stats.nBytes;
+    BMG_StatsTotal.nRefills += BMG_Stats.nRefills;
+    BMG_StatsTotal.nCandidates += BMG_Stats.nCandidates;
+    BMG_StatsTotal.nMatches += BMG_Stats.nMatches;
+    BMG_StatsTotal.IoTime += BMG_Stats.IoTime;
+    BMG_StatsTotal.ScanTime += BMG_Stats.ScanTime;
+
+    memset(&BMG_Stats, 0, sizeof(BMG_Stats));
+}
+
+/* Input    : pCtrl - pointer to structure containg output and ctrl info
+ *            pStats - counter set to report
+ *            pLabel - file name or "total"
+ *
+ * Prints one counter set through the message stream. The mean table
+ * skip is the average of the delta table over all byte values, i.e.
+ * how far the skip loop advances per probe on input that is unrelated
+ * to the pattern; a low value points at an unlucky pattern rather
+ * than at I/O.
+ */
+void BMG_StatsReport(OUTPUT_CTRL *pCtrl, BMG_STATS *pStats, const char *pLabel)
+{
+    long Sum = 0;
+    int c;
+
+    for (c = 0; c < 256; c++)
+        Sum += (BMG_Delta0[c] == BMG_Large) ? 0 : BMG_Delta0[c];
+
+    fprintf(pCtrl->fpMsg,
+            "%s: %llu bytes in %lu refills, %lu candidates, %lu matches,\n"
+            "%s: mean table skip %.1f, read/write %.3fs, scan %.3fs\n",
+            pLabel, pStats->nBytes, pStats->nRefills,
+            pStats->nCandidates, pStats->nMatches,
+            pLabel, (double) Sum / 256.0, pStats->IoTime, pStats->ScanTime);
+}
+
+/* Input    : c - byte value
+ * Returns  : coarse ranking of how common the byte is, smaller is rarer
+ *
+ * Static frequency estimate for typical text and binary data, used to
+ * pick the scan byte for the vector kernel and the anchor window of a
+ * long pattern. A bad guess is harmless, it only costs extra candidate
+ * verifications.
+ */
+static int ByteRank(unsigned char c)
+{
+    if (c == 0x00 || c == 0xff || c == ' ' || c == 'e' || c == 't' ||
+        c == 'a' || c == 'o' || c == 'i' || c == 'n' || c == 's')
+        return 4;
+    if (islower((int) c))
+        return 3;
+    if (isupper((int) c) || isdigit((int) c))
+        return 2;
+    if (isprint((int) c) || c == 0x0a || c == 0x0d || c == 0x09)
+        return 1;
+    return 0;
+}
+
+/* State for the scan kernels. BMG_ScanFunc is NULL when the delta
+ * table loop is to be used; otherwise it finds the next candidate, i.e.
+ * the position of the last pattern byte of the next plausible match.
+ */
+static unsigned char *(*BMG_ScanFunc)(unsigned char *, unsigned char *);
+static unsigned char BMG_RareByte;   /* rarest byte of the pattern */
+static int           BMG_RareBack;   /* distance from rare byte to last byte */
+
+/* Input    : k - first allowed position for the last byte of a match
+ *            strend - end of the text to scan
+ * Returns  : position of the next occurrence of a one byte pattern,
+ *            NULL when the text is exhausted
+ *
+ * A one byte pattern reduces the search to memchr, which every library
+ * worth its salt vectorizes; the delta loop would hop a single byte at
+ * a time. The LF side of the line ending conversions lands here.
+ */
+static unsigned char *ScanByte(unsigned char *k, unsigned char *strend)
+{
+    return (unsigned char *) memchr(k, BMG_Pattern[0], (size_t) (strend - k));
+}
+
+/* Input    : k - first allowed position for the last byte of a match
+ *            strend - end of the text to scan
+ * Returns  : position of the last pattern byte of the next candidate,
+ *            NULL when the text is exhausted
+ *
+ * Kernel for patterns of 2 to 4 bytes, whose delta hops are too short
+ * to beat a vectorized library scan. memchr runs on the rarest pattern
+ * byte and each hit is screened against the last pattern byte, so a
+ * returned candidate has the same guarantee as the delta table
+ * sentinel.
+ */
+static unsigned char *ScanShort(unsigned char *k, unsigned char *strend)
+{
+    unsigned char *p = k - BMG_RareBack;
+    unsigned char *pend = strend - BMG_RareBack;
+
+    while (p < pend)
+    {
+        if ((p = (unsigned char *) memchr(p, BMG_RareByte,
+                                          (size_t) (pend - p))) == NULL)
+            return NULL;
+
+        if (p[BMG_RareBack] == BMG_Pattern[BMG_Patlen - 1])
+            return p + BMG_RareBack;
+        p++;
+    }
+
+    return NULL;
+}
+
+#ifdef GSAR_SIMD
+
+/* Input    : k - first allowed position for the last byte of a match
+ *            strend - end of the text to scan
+ * Returns  : position of the last pattern byte of the next candidate,
+ *            NULL when the text is exhausted
+ *
+ * Scans 16 bytes at a time for the rarest pattern byte at its offset in
+ * the pattern and screens each hit against the last pattern byte, so a
+ * returned candidate has the same guarantee as the delta table sentinel.
+ */
+static unsigned char *SimdScanSSE2(unsigned char *k, unsigned char *strend)
+{
+    unsigned char *p = k - BMG_RareBack;
+    unsigned char *pend = strend - BMG_RareBack;
+    unsigned int Mask;
+    __m128i Rare = _mm_set1_epi8((char) BMG_RareByte);
+    __m128i Chunk;
+
+    while (p + 16 <= pend)
+    {
+        Chunk = _mm_loadu_si128((__m128i const *) p);
+        Mask = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(Chunk, Rare));
+
+        while (Mask)
+        {
+            unsigned char *pHit = p + __builtin_ctz(Mask);
+
+            if (pHit[BMG_RareBack] == BMG_Pattern[BMG_Patlen - 1])
+                return pHit + BMG_RareBack;
+
+            Mask &= Mask - 1;
+        }
+        p += 16;
+    }
+
+    while (p < pend)
+    {
+        if (*p == BMG_RareByte && p[BMG_RareBack] == BMG_Pattern[BMG_Patlen - 1])
+            return p + BMG_RareBack;
+        p++;
+    }
+
+    return NULL;
+}
+
+/* 32 bytes at a time variant of the above, used when the CPU has AVX2
+ */
+__attribute__((target("avx2")))
+static unsigned char *SimdScanAVX2(unsigned char *k, unsigned char *strend)
+{
+    unsigned char *p = k - BMG_RareBack;
+    unsigned char *pend = strend - BMG_RareBack;
+    unsigned int Mask;
+    __m256i Rare = _mm256_set1_epi8((char) BMG_RareByte);
+    __m256i Chunk;
+
+    while (p + 32 <= pend)
+    {
+        Chunk = _mm256_loadu_si256((__m256i const *) p);
+        Mask = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(Chunk, Rare));
+
+        while (Mask)
+        {
+            unsigned char *pHit = p + __builtin_ctz(Mask);
+
+            if (pHit[BMG_RareBack] == BMG_Pattern[BMG_Patlen - 1])
+                return pHit + BMG_RareBack;
+
+            Mask &= Mask - 1;
+        }
+        p += 32;
+    }
+
+    while (p < pend)
+    {
+        if (*p == BMG_RareByte && p[BMG_RareBack] == BMG_Pattern[BMG_Patlen - 1])
+            return p + BMG_RareBack;
+        p++;
+    }
+
+    return NULL;
+}
+
+#endif /* GSAR_SIMD */
+
+
+/* Input  : pCtrl - pointer to structure containg output and ctrl info
+ *          FileOfs - actual offset in file
+ *          BufOfs - match offset in search buffer
+ *          PatLen - length of the pattern that matched
+ *          pStart - pointer to start of the search buffer
+ *          pEnd - pointer to end of the search buffer
+ *
+ * Returns: nothing
+ *
+ * Displays buffer information (filename, offset, context) according
+ * to the flags set in the structure. i.e. be a bit verbose.
+ *
+ * The record is rendered into a format buffer kept in the context and
+ * handed to the message stream with a single fwrite; going through
+ * stdio a character at a time used to cost more than the search
+ * itself on match heavy scans. With fRecords set the display format
+ * is replaced by a machine readable record, filespec and decimal
+ * offset as two NUL terminated fields, so downstream tools can split
+ * on NUL instead of parsing the display format.
+ */
+static void Verbose(OUTPUT_CTRL *pCtrl, unsigned long long FileOfs, int BufOfs,
+             int PatLen, unsigned char *pStart, unsigned char *pEnd)
+{
+    unsigned char *pSC;        /* start of context */
+    unsigned char *pEC;        /* end of context */
+    unsigned char *pLastSC;    /* last start of context */
+
+    unsigned long long CtxOfs; /* context offset */
+
+    char *pOut;                /* cursor into the format buffer */
+    long Need;                 /* worst case size of this record */
+
+    int i;                     /* loop counter */
+
+    /* the binary record sink replaces the display formats entirely */
+    if (pCtrl->pfEmitRec != NULL)
+    {
+        (*pCtrl->pfEmitRec)(pCtrl, FileOfs + BufOfs);
+        return;
+    }
+
+    /* the hex dump needs about 70 characters per 16 context bytes, the
+     * rest is the filespec and offset lines plus slack
+     */
+    Need = (long) strlen(pCtrl->pInputFile) + 6L * pCtrl->Context + 256;
+
+    if (pCtrl->pFmtBuf == NULL || Need > pCtrl->FmtSiz)
+    {
+        free(pCtrl->pFmtBuf);
+        if ((pCtrl->pFmtBuf = (char *) malloc((size_t) Need)) == NULL)
+            Abort("error, unable to allocate match format buffer");
+        pCtrl->FmtSiz = Need;
+    }
+
+    pOut = pCtrl->pFmtBuf;
+
+    if (pCtrl->fRecords)
+    {
+        pOut += sprintf(pOut, "%s", pCtrl->pInputFile) + 1;
+#ifdef MSDOS
+        pOut += sprintf(pOut, "%I64u", FileOfs + BufOfs) + 1;
+#else
+        pOut += sprintf(pOut, "%llu", FileOfs + BufOfs) + 1;
+#endif
+        fwrite(pCtrl->pFmtBuf, 1, (size_t) (pOut - pCtrl->pFmtBuf), pCtrl->fpMsg);
+        return;
+    }
+
+    if (pCtrl->fFileSpec)
+    { /* display file name */
+        pOut += sprintf(pOut, "%s: ", pCtrl->pInputFile);
+    }
+
+    if (pCtrl->fByteOffset)              /* display byte offset */
+    {
+#ifdef MSDOS
+        pOut += sprintf(pOut, "0x%I64x%s", FileOfs + BufOfs, (pCtrl->fTextual) ? ": " : "");
+#else
+        pOut += sprintf(pOut, "0x%llx%s",  FileOfs + BufOfs, (pCtrl->fTextual) ? ": " : "");
+#endif
+    }
+
+    /* Display a textual or a hexadecimal context
+     */
+    if (pCtrl->fTextual || pCtrl->fHex)
+    {
+        pSC = pStart + BufOfs - pCtrl->Context / 2 + PatLen / 2;
+        if (pSC < pStart)                /* outside the buffer ? */
+            pSC = pStart;
+
+        pEC = pSC + pCtrl->Context;
+        if (pEC > pEnd)                  /* outside the buffer ? */
+        {
+            pEC = pEnd;
+
+            /* if we have to truncate to pEnd readjust the start
+             * of the context if possible.
+             */
+            if (pEC - pCtrl->Context > pStart)
+                pSC = pEC - pCtrl->Context;
+        }
+
+        /* display a hexadecimal context
+         */
+        if (pCtrl->fHex)
+        {
+            *pOut++ = '\n';
+
+            CtxOfs = FileOfs + (pSC - pStart);
+
+            while (pSC != pEC)
+            {
+                pLastSC = pSC;                /* remember where we started */
+
+#ifdef MSDOS
+                pOut += sprintf(pOut, "0x%0I64x: ", CtxOfs); /* hex offset */
+#else
+                pOut += sprintf(pOut, "0x%0llx: ", CtxOfs); /* hex offset */
+#endif
+
+                for (i = 0; i < 16; i++)        /* display 16 hex digits */
+                {
+                    if (pSC != pEC)
+                        pOut += sprintf(pOut, "%02x ", (unsigned char) * pSC++);
+                    else
+                    {
+                        memcpy(pOut, "   ", 3);
+                        pOut += 3;
+                    }
+                }
+
+                pSC = pLastSC;                             /* start again */
+
+                for (i = 0; i < 16; i++)       /* display 16 characters */
+                {
+                    if (pSC != pEC)
+                    {
+#ifdef MSDOS      /* MSDOS can display all characters except CTRL chars */
+                        if (!iscntrl((int) * pSC))
+#else             /* its __UNIX__ */
+                        if (isprint((int) * pSC))
+#endif
+                            *pOut++ = (char) *pSC;
+                        else
+                            *pOut++ = '.';
+
+                        pSC++;
+                    }
+                }
+                CtxOfs += 16;             /* increment context offset by 16 */
+                *pOut++ = '\n';
+            }
+
+        }
+
+        /* display textual context...
+         */
+        if (pCtrl->fTextual)
+        {
+            while (pSC != pEC)
+            {
+#ifdef MSDOS   /* MSDOS can display all characters except CTRL chars */
+                if (!iscntrl((int) * pSC))
+#else          /* its __UNIX__ */
+                if (isprint((int) * pSC))
+#endif
+                    *pOut++ = (char) *pSC;
+                else
+                    *pOut++ = '.';
+
+                pSC++;
+            }
+        }
+    }
+
+    if (!pCtrl->fHex)
+        *pOut++ = '\n';
+
+    fwrite(pCtrl->pFmtBuf, 1, (size_t) (pOut - pCtrl->pFmtBuf), pCtrl->fpMsg);
+}
+
+
+/* Input    : k - position of the last byte of a confirmed anchor match
+ *            pStart - first valid byte of the text
+ *            strend - end of the valid data
+ * Returns  : 1 - the full pattern matches around the anchor
+ *            0 - no match, or the window is not entirely in memory
+ *
+ * Completes an anchored candidate. A window that runs off either end
+ * of the data is no match here; at a buffer seam the carried tail of
+ * BMG_FullLen - 1 bytes brings the same window back complete in the
+ * next buffer.
+ */
+static int FullVerify(unsigned char *k, unsigned char *pStart, unsigned char *strend)
+{
+    unsigned char *p = k - (BMG_Patlen - 1) - BMG_AnchorOfs;
+    int j;
+
+    if (p < pStart || p + BMG_FullLen > strend)
+        return 0;
+
+    if (BMG_fExact)
+        return memcmp(p, BMG_FullPat, (size_t) BMG_FullLen) == 0;
+
+    for (j = 0; j < BMG_FullLen; j++)
+        if (BMG_Cmap[p[j]] != BMG_FullPat[j])
+            return 0;
+
+    return 1;
+}
+
+
+/* The algorithm requires a test against an address outside the buffer */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Warray-bounds"
+
+/* Input    : pCtrl - pointer to structure containg output and ctrl info
+ * Returns  : number of matches found in file
+ *
+ * The pattern to search for must already have been set up using BMG_Setup
+ *
+ * Works by applying the BMG algorithm to a buffer. To ensure the pattern
+ * is not inadvertently chopped up, BMG_Patlen - 1 bytes is always moved
+ * to the start of the buffer. The next time we fill the buffer we fill it
+ * with BMG_BufSiz - (BMG_Patlen - 1) bytes.
+ */
+long BMG_Search(OUTPUT_CTRL *pCtrl)
+{
+    register unsigned char *k;
+    register unsigned char *s;
+    register unsigned char *strend;
+
+    register int j;
+
+    unsigned char *Buffer = (pCtrl->pBuffer != NULL) ? pCtrl->pBuffer : BMG_Buffer;
+
+    int  nTrans = 0;   /* number of bytes to transfer to the start of the buffer */
+    int  BufOfs;       /* buffer offset for each match */
+    long Cnt = BMG_BufSiz;
+
+    long nMatches = 0;                  /* number of matches found */
+    long nBytes;                        /* number of bytes read */
+    unsigned long long FileOfs = 0;     /* current file offset */
+    double t0 = 0.0;                    /* start of the open stats bucket */
+
+    unsigned char *pResume;  /* last letter of the previous match, for the
+                              * Galil resume of periodic patterns */
+
+    for (;;)
+    {
+        if (BMG_fStats)
+            t0 = StatTime();
+
+        nBytes = fread(&Buffer[nTrans], 1, (size_t) Cnt, pCtrl->fpIn);
+
+        if (BMG_fStats)
+        {
+            BMG_Stats.IoTime += StatTime() - t0;
+            t0 = StatTime();
+            if (nBytes)
+            {
+                BMG_Stats.nRefills++;
+                BMG_Stats.nBytes += (unsigned long long) nBytes;
+            }
+        }
+
+        if (!nBytes)
+            break;
+
+        if (BMG_pfProgress != NULL)
+            (*BMG_pfProgress)((unsigned long long) nBytes);
+
+        s = Buffer;
+
+        strend = s + nBytes + nTrans;
+
+        k = Buffer + BMG_AnchorOfs + BMG_Patlen - 1;
+        pResume = NULL;
+
+        for (;;)
+        {
+            if (BMG_ScanFunc != NULL)
+            {
+                if ((k = (*BMG_ScanFunc)(k, strend)) == NULL)
+                    break;
+            }
+            else
+            {
+                while ((k += BMG_Delta0[*(unsigned char *) k]) < strend)
+                    ;
+
+                if (k < (Buffer + BMG_Large))
+                    break;
+                k -= BMG_Large;
+
+                /* a candidate at or past strend cannot be a match; it
+                 * comes from the unused tail of the buffer, and when
+                 * that garbage also carries the last pattern byte the
+                 * walk would never leave it
+                 */
+                if (k >= strend)
+                    break;
+            }
+
+            if (BMG_fStats)
+                BMG_Stats.nCandidates++;
+
+            if (BMG_Period != 0 && pResume != NULL && k - pResume == BMG_Period)
+            {
+                /* the candidate overlaps the previous match by one
+                 * period, so only the bytes past that match can differ
+                 */
+                for (j = 1; j < BMG_Period; j++)
+                    if (BMG_Cmap[k[-j]] != BMG_Pattern[BMG_Patlen - 1 - j])
+                        break;
+                j = (j == BMG_Period) ? -1 : j;
+            }
+            else if (BMG_fExact)
+                j = (memcmp(k - BMG_Patlen + 1, BMG_Pattern,
+                            (size_t) BMG_Patlen) == 0) ? -1 : 0;
+            else
+            {
+                j = BMG_Patlen - 1;
+                s = k - 1;
+
+                while (BMG_Cmap[*s--] == BMG_Pattern[--j])
+                    ;
+            }
+
+            if (j >= 0)
+                k++;
+            else
+            {
+                if (k >= strend)
+                    break;
+
+                if (BMG_fAnchored && !FullVerify(k, Buffer, strend))
+                {
+                    k++;
+                    continue;
+                }
+
+                /* found submatch, k is on the last letter of the
+                 * scanned pattern */
+                BufOfs = k - Buffer + 1 - BMG_Patlen - BMG_AnchorOfs;
+                pResume = k;
+
+                nMatches++;
+                if (pCtrl->fVerbose)
+                    Verbose(pCtrl, FileOfs, BufOfs, BMG_FullLen, Buffer, strend);
+
+                if (BMG_MatchLimit != 0 && nMatches >= BMG_MatchLimit)
+                    break;
+
+                k++;
+            }
+        }
+
+        if (BMG_fStats)
+            BMG_Stats.ScanTime += StatTime() - t0;
+
+        if (BMG_MatchLimit != 0 && nMatches >= BMG_MatchLimit)
+            break;
+
+        nTrans = BMG_FullLen - 1;
+
+        memcpy(Buffer, strend - nTrans, nTrans); /* move remaining bytes to the start */
+        Cnt = BMG_BufSiz - nTrans;
+        FileOfs += Cnt;                              /* calculate file offset  */
+    }
+
+    if (BMG_fStats)
+        BMG_Stats.nMatches += (unsigned long) nMatches;
+
+    return nMatches;
+}
+
+
+#ifdef __UNIX__
+
+/* State shared between the reader thread and the scan loop of
+ * BMG_SearchAsync. Two buffers hand over through full flags guarded
+ * by the lock; the reader leaves the first BMG_Patlen - 1 bytes of
+ * every buffer after the first alone so the scan loop can drop the
+ * pattern tail of the previous buffer into the hole at its leisure.
+ */
+typedef struct
+{
+    FILE *fpIn;                /* stream to read from */
+    unsigned char *pBuf[2];    /* the two search buffers */
+    long nBytes[2];            /* bytes read into each buffer */
+    signed char fFull[2];      /* buffer holds unscanned data */
+    pthread_mutex_t Lock;
+    pthread_cond_t  Cond;
+} BMG_ASYNC;
+
+/* Reader thread: fills whichever buffer the scan loop is not using,
+ * so the next fread overlaps with the current scan. A zero length
+ * block is handed over as the end of file marker.
+ */
+static void *AsyncReader(void *pArg)
+{
+    BMG_ASYNC *pAsync = (BMG_ASYNC *) pArg;
+    long nBytes;
+    long Ofs = 0;        /* all buffers after the first leave the tail hole */
+    int  Inx = 0;
+
+    for (;;)
+    {
+        nBytes = (long) fread(pAsync->pBuf[Inx] + Ofs, 1,
+                              (size_t) (BMG_BufSiz - Ofs), pAsync->fpIn);
+
+        pthread_mutex_lock(&pAsync->Lock);
+        pAsync->nBytes[Inx] = nBytes;
+        pAsync->fFull[Inx] = 1;
+        pthread_cond_signal(&pAsync->Cond);
+
+        if (!nBytes)
+        {
+            pthread_mutex_unlock(&pAsync->Lock);
+            break;
+        }
+
+        Inx ^= 1;
+        Ofs = BMG_FullLen - 1;
+
+        while (pAsync->fFull[Inx])
+            pthread_cond_wait(&pAsync->Cond, &pAsync->Lock);
+        pthread_mutex_unlock(&pAsync->Lock);
+    }
+
+    return NULL;
+}
+
+/* Input    : pCtrl - pointer to structure containg output and ctrl info
+ * Returns  : number of matches found in file
+ *
+ * Double buffered variant of BMG_Search. A reader thread fills one
+ * buffer while the BMG loop scans the other, so on storage with any
+ * latency the read time hides behind the scan time instead of adding
+ * to it. Match semantics and the pattern tail carryover between
+ * buffers are exactly those of BMG_Search.
+ */
+long BMG_SearchAsync(OUTPUT_CTRL *pCtrl)
+{
+    register unsigned char *k;
+    register unsigned char *s;
+    register unsigned char *strend;
+
+    register int j;
+
+    BMG_ASYNC Async;
+    pthread_t Reader;
+    unsigned char *Buffer;
+    unsigned char *pResume;  /* last letter of the previous match, for the
+                              * Galil resume of periodic patterns */
+
+    int  nTrans = 0;   /* number of bytes to transfer to the start of the buffer */
+    int  BufOfs;       /* buffer offset for each match */
+    int  Inx = 0;      /* buffer being scanned */
+
+    long nMatches = 0;                  /* number of matches found */
+    long nBytes;                        /* number of bytes read */
+    unsigned long long FileOfs = 0;     /* current file offset */
+
+    Async.fpIn = pCtrl->fpIn;
+    Async.pBuf[0] = (pCtrl->pBuffer != NULL) ? pCtrl->pBuffer : BMG_Buffer;
+    Async.pBuf[1] = BMG_AllocBuffer();
+    Async.fFull[0] = Async.fFull[1] = 0;
+    pthread_mutex_init(&Async.Lock, NULL);
+    pthread_cond_init(&Async.Cond, NULL);
+
+    if (Async.pBuf[1] == NULL)
+        Abort("error, unable to allocate second search buffer");
+
+    if (pthread_create(&Reader, NULL, AsyncReader, &Async) != 0)
+        Abort("error, unable to create reader thread");
+
+    for (;;)
+    {
+        pthread_mutex_lock(&Async.Lock);
+        while (!Async.fFull[Inx])
+            pthread_cond_wait(&Async.Cond, &Async.Lock);
+        nBytes = Async.nBytes[Inx];
+        pthread_mutex_unlock(&Async.Lock);
+
+        if (!nBytes)
+            break;
+
+        if (BMG_pfProgress != NULL)
+            (*BMG_pfProgress)((unsigned long long) nBytes);
+
+        Buffer = Async.pBuf[Inx];
+
+        s = Buffer;
+
+        strend = s + nBytes + nTrans;
+
+        k = Buffer + BMG_AnchorOfs + BMG_Patlen - 1;
+        pResume = NULL;
+
+        for (;;)
+        {
+            if (BMG_ScanFunc != NULL)
+            {
+                if ((k = (*BMG_ScanFunc)(k, strend)) == NULL)
+                    break;
+            }
+            else
+            {
+                while ((k += BMG_Delta0[*(unsigned char *) k]) < strend)
+                    ;
+
+                if (k < (Buffer + BMG_Large))
+                    break;
+                k -= BMG_Large;
+
+                /* a candidate at or past strend cannot be a match; it
+                 * comes from the unused tail of the buffer, and when
+                 * that garbage also carries the last pattern byte the
+                 * walk would never leave it
+                 */
+                if (k >= strend)
+                    break;
+            }
+
+            if (BMG_Period != 0 && pResume != NULL && k - pResume == BMG_Period)
+            {
+                /* the candidate overlaps the previous match by one
+                 * period, so only the bytes past that match can differ
+                 */
+                for (j = 1; j < BMG_Period; j++)
+                    if (BMG_Cmap[k[-j]] != BMG_Pattern[BMG_Patlen - 1 - j])
+                        break;
+                j = (j == BMG_Period) ? -1 : j;
+            }
+            else if (BMG_fExact)
+                j = (memcmp(k - BMG_Patlen + 1, BMG_Pattern,
+                            (size_t) BMG_Patlen) == 0) ? -1 : 0;
+            else
+            {
+                j = BMG_Patlen - 1;
+                s = k - 1;
+
+                while (BMG_Cmap[*s--] == BMG_Pattern[--j])
+                    ;
+            }
+
+            if (j >= 0)
+                k++;
+            else
+            {
+                if (k >= strend)
+                    break;
+
+                if (BMG_fAnchored && !FullVerify(k, Buffer, strend))
+                {
+                    k++;
+                    continue;
+                }
+
+                /* found submatch, k is on the last letter of the
+                 * scanned pattern */
+                BufOfs = k - Buffer + 1 - BMG_Patlen - BMG_AnchorOfs;
+                pResume = k;
+
+                nMatches++;
+                if (pCtrl->fVerbose)
+                    Verbose(pCtrl, FileOfs, BufOfs, BMG_FullLen, Buffer, strend);
+
+                if (BMG_MatchLimit != 0 && nMatches >= BMG_MatchLimit)
+                    break;
+
+                k++;
+            }
+        }
+
+        nTrans = BMG_FullLen - 1;
+
+        /* move the pattern tail to the start of the other buffer; the
+         * reader never touches those bytes
+         */
+        memcpy(Async.pBuf[Inx ^ 1], strend - nTrans, nTrans);
+        FileOfs += BMG_BufSiz - nTrans;              /* calculate file offset  */
+
+        pthread_mutex_lock(&Async.Lock);
+        Async.fFull[Inx] = 0;
+        pthread_cond_signal(&Async.Cond);
+        pthread_mutex_unlock(&Async.Lock);
+
+        Inx ^= 1;
+
+        if (BMG_MatchLimit != 0 && nMatches >= BMG_MatchLimit)
+            break;
+    }
+
+    /* when the match limit cut the scan short the reader may still be
+     * busy, so drain its remaining blocks before joining it
+     */
+    for (;;)
+    {
+        pthread_mutex_lock(&Async.Lock);
+        while (!Async.fFull[Inx])
+            pthread_cond_wait(&Async.Cond, &Async.Lock);
+        nBytes = Async.nBytes[Inx];
+        Async.fFull[Inx] = 0;
+        pthread_cond_signal(&Async.Cond);
+        pthread_mutex_unlock(&Async.Lock);
+
+        if (!nBytes)
+            break;
+
+        Inx ^= 1;
+    }
+
+    pthread_join(Reader, NULL);
+    pthread_mutex_destroy(&Async.Lock);
+    pthread_cond_destroy(&Async.Cond);
+    free(Async.pBuf[1]);
+
+    return nMatches;
+}
+#endif /* __UNIX__ */
+
+
+/* Input    : pCtrl - pointer to structure containg output and ctrl info
+ *            pMem - pointer to a block of memory holding the entire file
+ *            nLen - number of bytes in the block
+ *            BaseOfs - file offset of the first byte of the block, zero
+ *                      when the block is the whole file
+ *
+ * Returns  : number of matches found in the block
+ *
+ * The pattern to search for must already have been set up using BMG_Setup
+ *
+ * Applies the BMG algorithm to a single contiguous block, typically a
+ * memory mapping of the whole input file. Since there is no buffer refill
+ * there is no transfer of a pattern tail either; the skip loop just runs
+ * from one end of the block to the other.
+ *
+ * The block may be far larger than BMG_Large so the sentinel overshoot trick
+ * used in BMG_Search cannot tell us where the candidate was. Instead the
+ * skip loop stops when the delta table yields the sentinel value. The
+ * match verification is also kept strictly within [pMem, pMem + nLen]
+ * as the pages surrounding a mapping need not be readable.
+ */
+long BMG_SearchMem(OUTPUT_CTRL *pCtrl, unsigned char *pMem, unsigned long long nLen,
+                   unsigned long long BaseOfs)
+{
+    register unsigned char *k;
+    register unsigned char *s;
+    register unsigned char *strend;
+
+    register int j;
+
+    unsigned long long MatchOfs;    /* offset of match in the block */
+    unsigned long long WinOfs;      /* start of the window handed to Verbose */
+
+    unsigned char *pResume = NULL;  /* last letter of the previous match, for
+                                     * the Galil resume of periodic patterns */
+
+    long nMatches = 0;              /* number of matches found */
+
+    if (nLen < (unsigned long long) BMG_FullLen)
+        return 0;
+
+    strend = pMem + nLen;
+    k = pMem + BMG_AnchorOfs + BMG_Patlen - 1;
+
+    for (;;)
+    {
+        if (BMG_ScanFunc != NULL)
+        {
+            if ((k = (*BMG_ScanFunc)(k, strend)) == NULL)
+                break;
+        }
+        else
+        {
+            while (k < strend && (j = BMG_Delta0[*(unsigned char *) k]) != BMG_Large)
+                k += j;
+
+            if (k >= strend)
+                break;
+        }
+
+        if (BMG_Period != 0 && pResume != NULL && k - pResume == BMG_Period)
+        {
+            /* the candidate overlaps the previous match by one period,
+             * so only the bytes past that match can differ
+             */
+            for (j = 1; j < BMG_Period; j++)
+                if (BMG_Cmap[k[-j]] != BMG_Pattern[BMG_Patlen - 1 - j])
+                    break;
+            j = (j == BMG_Period) ? -1 : j;
+        }
+        else if (BMG_fExact)
+            j = (memcmp(k - BMG_Patlen + 1, BMG_Pattern,
+                        (size_t) BMG_Patlen) == 0) ? -1 : 0;
+        else
+        {
+            j = BMG_Patlen - 2;
+            s = k - 1;
+
+            while (j >= 0 && BMG_Cmap[*s] == BMG_Pattern[j])
+            {
+                s--;
+                j--;
+            }
+        }
+
+        if (j >= 0)
+            k++;
+        else
+        {
+            if (BMG_fAnchored && !FullVerify(k, pMem, strend))
+            {
+                k++;
+                continue;
+            }
+
+            /* found submatch, k is on the last letter of the scanned
+             * pattern */
+            MatchOfs = (unsigned long long) (k - pMem) + 1 - BMG_Patlen - BMG_AnchorOfs;
+            pResume = k;
+
+            nMatches++;
+            if (pCtrl->fVerbose)
+            {
+                /* Verbose takes an int buffer offset, so hand it a small
+                 * window around the match rather than the whole block
+                 */
+                WinOfs = (MatchOfs > (unsigned long long) BMG_Large)
+                             ? MatchOfs - (unsigned long long) BMG_Large : 0;
+                Verbose(pCtrl, BaseOfs + WinOfs, (int) (MatchOfs - WinOfs),
+                        BMG_FullLen, pMem + WinOfs, strend);
+            }
+
+            if (BMG_MatchLimit != 0 && nMatches >= BMG_MatchLimit)
+                break;
+
+            k++;
+        }
+    }
+
+    return nMatches;
+}
+
+
+/* Input    : pCtrl - context with the input stream and the open hook
+ *            pOut - scratch buffer for the copy, empty at this point
+ *            OutCap - size of the scratch buffer
+ *            nPrefix - number of bytes from the start of the input file
+ *                      that have been scanned but never written
+ * Returns  : 0 on success, -1 on any I/O failure
+ *
+ * Called on the first match of a lazily opened replace run. Creates the
+ * output file through the open hook and bulk copies the already scanned
+ * prefix by rereading the input from the start, then restores the read
+ * position so the replace loop can continue where it was.
+ */
+static int CopyPrefix(OUTPUT_CTRL *pCtrl, unsigned char *pOut, long OutCap,
+                      unsigned long long nPrefix)
+{
+    long   CurPos;
+    size_t nChunk;
+
+    if (pCtrl->pfOpenOut == NULL ||
+        (pCtrl->fpOut = (*pCtrl->pfOpenOut)(pCtrl)) == NULL)
+        return -1;
+
+    if (nPrefix == 0)
+        return 0;
+
+    if ((CurPos = ftell(pCtrl->fpIn)) == -1L ||
+        fseek(pCtrl->fpIn, 0L, SEEK_SET) != 0)
+        return -1;
+
+    while (nPrefix > 0)
+    {
+        nChunk = (nPrefix > (unsigned long long) OutCap) ? (size_t) OutCap
+                                                         : (size_t) nPrefix;
+        if (fread(pOut, 1, nChunk, pCtrl->fpIn) != nChunk)
+            return -1;
+        if (fwrite(pOut, 1, nChunk, pCtrl->fpOut) != nChunk)
+            return -1;
+        nPrefix -= nChunk;
+    }
+
+    return (fseek(pCtrl->fpIn, CurPos, SEEK_SET) != 0) ? -1 : 0;
+}
+
+
+/* Input    : pCtrl - output stream owner
+ *            pOut - gathered output arena
+ *            pnOut - bytes staged in the arena, reset to zero on success
+ * Returns  : 0 on success, -1 if the write came up short
+ *
+ * Flushes the gathered output arena with a single fwrite.
+ */
+static int FlushOut(OUTPUT_CTRL *pCtrl, unsigned char *pOut, long *pnOut)
+{
+    if (*pnOut == 0)
+        return 0;
+
+    if (fwrite(pOut, sizeof(unsigned char), (size_t) *pnOut, pCtrl->fpOut) != (size_t) *pnOut)
+        return -1;
+
+    *pnOut = 0;
+    return 0;
+}
+
+
+/* Input    : pCtrl - pointer to structure containg output and ctrl info
+ *            ReplaceBuf - pointer to buffer which contains replacement
+ *            nReplace - number of bytes in replace buffer
+ *
+ * Returns  : number of matches & replaces performed
+ *            -1 if error in fwrite, disk might be full, or removed
+ *
+ * The pattern to search for must already have been set up using BMG_Setup
+ *
+ * Works by applying the BMG algorithm to a buffer. To ensure the pattern
+ * is not inadvertently chopped up we have to be a little careful. Since
+ * we're doing a search and replace we can't copy BMG_Patlen - 1 bytes
+ * always. Consider the following:
+ *
+ * We're searching for 'aa' in the string 'aaaa'
+ * This will give a result of 3 matches namely: a[0]a[1] a[1]a[2] a[2]a[3]
+ *
+ * But if we're searching for 'aa' and replacing with 'xx' in 'aaaa'
+ * This will give a result of 2 matches and the new buffer:   'xxxx'
+ * After a match of a[0]a[1] we must start the next search at a[2].
+ *
+ * So if we have a match at the exact end of the buffer. We must
+ * not transfer anything to the start.
+ *
+ * Use the following algorithm:
+ *
+ * Calculate the distance between the last match and the end of the buffer
+ * and call this distance n.
+ *
+ * n = end of buffer - last match
+ * if n >= Bmg_Patlen we transfer BMG_Patlen - 1 bytes to the start
+ * if n < Bmg_Patlen we transfer n bytes to the start of the buffer
+ */
+long BMG_SearchReplace(OUTPUT_CTRL *pCtrl, char *pReplaceBuf, unsigned int nReplace)
+{
+    register unsigned char *k;
+    register unsigned char *s;
+    register unsigned char *strend;
+
+    register int j;
+    register int n;
+    unsigned char *pLast;
+
+    unsigned char *Buffer = (pCtrl->pBuffer != NULL) ? pCtrl->pBuffer : BMG_Buffer;
+
+    int  nTrans = 0;   /* number of bytes to transfer to the start of the buffer */
+    int  BufOfs;       /* buffer offset for each match */
+    long Cnt = BMG_BufSiz;
+
+    long nMatches = 0;                       /* number of matches found */
+    long nBytes;                             /* number of bytes read */
+    unsigned long long FileOfs = 0;          /* current file offset */
+    double t0 = 0.0;                         /* start of the open stats bucket */
+
+    unsigned char *pOutBuf;                  /* gathered output arena */
+    long OutLen = 0;                         /* bytes staged in the arena */
+    long OutCap;                             /* size of the arena */
+
+    /* with no open output stream nothing is written until the first
+     * match; files without matches then cost no write I/O at all
+     */
+    int fLazy = (pCtrl->fpOut == NULL);
+
+    /* output is gathered into the arena and flushed with one fwrite per
+     * input buffer instead of two stdio calls per match; large enough
+     * that an overflow flush within a buffer stays the exception
+     */
+    OutCap = BMG_BufSiz + 2 * (((long) nReplace > PAT_BUFSIZ) ? (long) nReplace
+                                                              : PAT_BUFSIZ);
+    if ((pOutBuf = (unsigned char *) malloc((size_t) OutCap)) == NULL)
+        Abort("error, unable to allocate output buffer");
+
+    for (;;)
+    {
+        if (BMG_fStats)
+            t0 = StatTime();
+
+        nBytes = (unsigned long) fread(&Buffer[nTrans], sizeof(unsigned char), (size_t) Cnt, pCtrl->fpIn);
+
+        if (BMG_fStats)
+        {
+            BMG_Stats.IoTime += StatTime() - t0;
+            t0 = StatTime();
+            if (nBytes)
+            {
+                BMG_Stats.nRefills++;
+                BMG_Stats.nBytes += (unsigned long long) nBytes;
+            }
+        }
+
+        if (!nBytes)
+        {
+            if (fLazy)      /* no match was ever found, nothing to write */
+                break;
+
+            if (OutLen + nTrans > OutCap && FlushOut(pCtrl, pOutBuf, &OutLen) != 0)
+            {
+                free(pOutBuf);
+                return -1;
+            }
+            memcpy(pOutBuf + OutLen, Buffer, nTrans);
+            OutLen += nTrans;
+
+            if (FlushOut(pCtrl, pOutBuf, &OutLen) != 0)
+            {
+                free(pOutBuf);
+                return -1;
+            }
+            break;
+        }
+
+        if (BMG_pfProgress != NULL)
+            (*BMG_pfProgress)((unsigned long long) nBytes);
+
+        s = Buffer;
+        pLast = s;
+
+        strend = s + nBytes + nTrans;
+
+        k = Buffer + BMG_AnchorOfs + BMG_Patlen - 1;
+
+        for (;;)
+        {
+            if (BMG_ScanFunc != NULL)
+            {
+                if ((k = (*BMG_ScanFunc)(k, strend)) == NULL)
+                    break;
+            }
+            else
+            {
+                while ((k += BMG_Delta0[*(unsigned char *) k]) < strend)
+                    ;
+
+                if (k < (Buffer + BMG_Large))
+                    break;
+                k -= BMG_Large;
+
+                /* a candidate at or past strend cannot be a match; it
+                 * comes from the unused tail of the buffer, and when
+                 * that garbage also carries the last pattern byte the
+                 * walk would never leave it
+                 */
+                if (k >= strend)
+                    break;
+            }
+
+            if (BMG_fStats)
+                BMG_Stats.nCandidates++;
+
+            if (BMG_fExact)
+                j = (memcmp(k - BMG_Patlen + 1, BMG_Pattern,
+                            (size_t) BMG_Patlen) == 0) ? -1 : 0;
+            else
+            {
+                j = BMG_Patlen - 1;
+                s = k - 1;
+
+                while (BMG_Cmap[*s--] == BMG_Pattern[--j])
+                    ;
+            }
+
+            if (j >= 0)
+                k++;
+            else
+            {
+                if (k >= strend)
+                    break;
+
+                if (BMG_fAnchored && !FullVerify(k, Buffer, strend))
+                {
+                    k++;
+                    continue;
+                }
+
+                /* found submatch, k is on the last letter of the
+                 * scanned pattern */
+                BufOfs = k - Buffer + 1 - BMG_Patlen - BMG_AnchorOfs;
+
+                n = (Buffer + BufOfs) - pLast;
+                k++;
+
+                if (n >= 0)
+                {
+                    nMatches++;
+
+                    if (pCtrl->fVerbose)
+                        Verbose(pCtrl, FileOfs, BufOfs, BMG_FullLen, Buffer, strend);
+
+                    if (fLazy)
+                    {
+                        /* everything before the current buffer has only
+                         * been scanned; copy it into the fresh output
+                         * before staging the first replacement
+                         */
+                        if (CopyPrefix(pCtrl, pOutBuf, OutCap, FileOfs) != 0)
+                        {
+                            free(pOutBuf);
+                            return -1;
+                        }
+                        fLazy = 0;
+                    }
+
+                    if (OutLen + n + (long) nReplace > OutCap &&
+                        FlushOut(pCtrl, pOutBuf, &OutLen) != 0)
+                    {
+                        free(pOutBuf);
+                        return -1;
+                    }
+
+                    memcpy(pOutBuf + OutLen, pLast, n);
+                    OutLen += n;
+                    memcpy(pOutBuf + OutLen, pReplaceBuf, nReplace);
+                    OutLen += (long) nReplace;
+
+                    /* set last marker past the full match to write from */
+                    pLast = Buffer + BufOfs + BMG_FullLen;
+                }
+            }
+        }
+
+        n = strend - pLast;
+
+        if (n >= BMG_FullLen)
+        {
+            if (!fLazy)
+            {
+                if (OutLen + n - BMG_FullLen + 1 > OutCap &&
+                    FlushOut(pCtrl, pOutBuf, &OutLen) != 0)
+                {
+                    free(pOutBuf);
+                    return -1;
+                }
+                memcpy(pOutBuf + OutLen, pLast, n - BMG_FullLen + 1);
+                OutLen += n - BMG_FullLen + 1;
+            }
+            nTrans = BMG_FullLen - 1;
+        }
+        else
+        {
+            nTrans = n;
+        }
+
+        if (BMG_fStats)
+        {
+            BMG_Stats.ScanTime += StatTime() - t0;
+            t0 = StatTime();
+        }
+
+        /* one gathered write per input buffer */
+        if (FlushOut(pCtrl, pOutBuf, &OutLen) != 0)
+        {
+            free(pOutBuf);
+            return -1;
+        }
+
+        if (BMG_fStats)
+            BMG_Stats.IoTime += StatTime() - t0;
+
+        memcpy(Buffer, strend - nTrans, nTrans); /* move remaining bytes to the start */
+
+        Cnt = BMG_BufSiz - nTrans;
+        FileOfs += Cnt;  /* calculate file offset  */
+    }
+
+    free(pOutBuf);
+
+    if (BMG_fStats)
+        BMG_Stats.nMatches += (unsigned long) nMatches;
+
+    return nMatches;
+}
+
+
+/* Input    : pCtrl - pointer to structure containg output and ctrl info
+ *            pReplaceBuf - pointer to buffer which contains replacement
+ *            nReplace - number of bytes in replace buffer
+ *
+ * Returns  : number of matches & replaces performed
+ *            -1 if error in writing to the file
+ *
+ * In place variant of BMG_SearchReplace for the case where search and
+ * replace strings have the same length. pCtrl->fpIn must be open for
+ * update ("r+b"); only the matched byte ranges are overwritten with a
+ * seek and a write each, nothing else in the file is touched. Match
+ * semantics (no overlapping replacements) are those of the copying
+ * variant. Patched ranges all lie before the resume position so the
+ * update stream discipline of a seek between read and write is kept.
+ */
+long BMG_ReplaceInPlace(OUTPUT_CTRL *pCtrl, char *pReplaceBuf, unsigned int nReplace)
+{
+    register unsigned char *k;
+    register unsigned char *s;
+    register unsigned char *strend;
+
+    register int j;
+    register int n;
+    unsigned char *pLast;
+
+    unsigned char *Buffer = (pCtrl->pBuffer != NULL) ? pCtrl->pBuffer : BMG_Buffer;
+
+    int  nTrans = 0;   /* number of bytes to transfer to the start of the buffer */
+    int  BufOfs;       /* buffer offset for each match */
+    long Cnt = BMG_BufSiz;
+
+    long nMatches = 0;                       /* number of matches found */
+    long nBytes;                             /* number of bytes read */
+    long ReadPos;                            /* file position to resume reading at */
+    unsigned long long FileOfs = 0;          /* current file offset */
+
+    for (;;)
+    {
+        nBytes = (unsigned long) fread(&Buffer[nTrans], sizeof(unsigned char), (size_t) Cnt, pCtrl->fpIn);
+
+        if (!nBytes)
+            break;
+
+        if (BMG_pfProgress != NULL)
+            (*BMG_pfProgress)((unsigned long long) nBytes);
+
+        ReadPos = ftell(pCtrl->fpIn);
+
+        s = Buffer;
+        pLast = s;
+
+        strend = s + nBytes + nTrans;
+
+        k = Buffer + BMG_AnchorOfs + BMG_Patlen - 1;
+
+        for (;;)
+        {
+            if (BMG_ScanFunc != NULL)
+            {
+                if ((k = (*BMG_ScanFunc)(k, strend)) == NULL)
+                    break;
+            }
+            else
+            {
+                while ((k += BMG_Delta0[*(unsigned char *) k]) < strend)
+                    ;
+
+                if (k < (Buffer + BMG_Large))
+                    break;
+                k -= BMG_Large;
+
+                /* a candidate at or past strend cannot be a match; it
+                 * comes from the unused tail of the buffer, and when
+                 * that garbage also carries the last pattern byte the
+                 * walk would never leave it
+                 */
+                if (k >= strend)
+                    break;
+            }
+
+            if (BMG_fExact)
+                j = (memcmp(k - BMG_Patlen + 1, BMG_Pattern,
+                            (size_t) BMG_Patlen) == 0) ? -1 : 0;
+            else
+            {
+                j = BMG_Patlen - 1;
+                s = k - 1;
+
+                while (BMG_Cmap[*s--] == BMG_Pattern[--j])
+                    ;
+            }
+
+            if (j >= 0)
+                k++;
+            else
+            {
+                if (k >= strend)
+                    break;
+
+                if (BMG_fAnchored && !FullVerify(k, Buffer, strend))
+                {
+                    k++;
+                    continue;
+                }
+
+                /* found submatch, k is on the last letter of the
+                 * scanned pattern */
+                BufOfs = k - Buffer + 1 - BMG_Patlen - BMG_AnchorOfs;
+
+                n = (Buffer + BufOfs) - pLast;
+                k++;
+
+                if (n >= 0)
+                {
+                    nMatches++;
+
+                    if (pCtrl->fVerbose)
+                        Verbose(pCtrl, FileOfs, BufOfs, BMG_FullLen, Buffer, strend);
+
+                    if (fseek(pCtrl->fpIn, (long) (FileOfs + BufOfs), SEEK_SET) != 0)
+                        return -1;
+                    if (fwrite(pReplaceBuf, sizeof(unsigned char), nReplace, pCtrl->fpIn) != nReplace)
+                        return -1;
+                    if (fflush(pCtrl->fpIn) != 0)
+                        return -1;
+                    if (fseek(pCtrl->fpIn, ReadPos, SEEK_SET) != 0)
+                        return -1;
+
+                    /* set last marker past the full match to continue from */
+                    pLast = Buffer + BufOfs + BMG_FullLen;
+                }
+            }
+        }
+
+        n = strend - pLast;
+
+        if (n >= BMG_FullLen)
+            nTrans = BMG_FullLen - 1;
+        else
+            nTrans = n;
+
+        memcpy(Buffer, strend - nTrans, nTrans); /* move remaining bytes to the start */
+
+        Cnt = BMG_BufSiz - nTrans;
+        FileOfs += Cnt;  /* calculate file offset  */
+    }
+
+    return nMatches;
+}
+
+#pragma GCC diagnostic pop
+
+
+/* Input    : pat - pointer to pattern string
+ *            PatLen - actual length of the pattern
+ *            fFolded - flag which determines case folding
+ * Returns  : nothing
+ *
+ * Set up & compute Boyer-Moore delta (jump) table
+ */
+void BMG_Setup(char *pat, int PatLen, char fFolded)
+{
+    register int j;
+    int p, i;
+
+    if (BMG_Buffer == NULL && (BMG_Buffer = BMG_AllocBuffer()) == NULL)
+        Abort("error, unable to allocate search buffer of %ld bytes", BMG_BufSiz);
+
+    /* the streaming engines carry a pattern length of tail between
+     * buffer refills, so the pattern must fit the buffer with room for
+     * at least one new byte
+     */
+    if ((long) PatLen >= BMG_BufSiz)
+        Abort("error, the pattern must be shorter than the search buffer, raise the 'm' option");
+
+    free(BMG_FullPat);
+    if ((BMG_FullPat = (unsigned char *) malloc((size_t) PatLen)) == NULL)
+        Abort("error, unable to allocate pattern storage");
+
+    BMG_FullLen = PatLen;
+
+    if (fFolded)
+    {
+        /* fold case while saving pattern */
+        for (j = 0; j < PatLen; j++)
+            BMG_FullPat[j] = (isupper((int) pat[j])
+                              ? (unsigned char) tolower((int) pat[j]) : pat[j]);
+    }
+    else
+        memcpy(BMG_FullPat, (unsigned char *) pat, PatLen);
+
+    /* A pattern longer than the delta table was sized for is scanned
+     * through an anchor window of PAT_BUFSIZ bytes; the skip distance
+     * is then the window length, which is already at the point of
+     * diminishing returns. The window is slid to end on the rarest
+     * byte available since the ending byte is the one the skip loop
+     * stops on, and every hit is completed by FullVerify.
+     */
+    BMG_fAnchored = (PatLen > PAT_BUFSIZ);
+    BMG_AnchorOfs = 0;
+    BMG_Patlen = PatLen;
+
+    if (BMG_fAnchored)
+    {
+        int Best = PAT_BUFSIZ - 1;
+
+        for (j = PAT_BUFSIZ - 1; j < PatLen; j++)
+            if (ByteRank(BMG_FullPat[j]) < ByteRank(BMG_FullPat[Best]))
+                Best = j;
+
+        BMG_AnchorOfs = Best - (PAT_BUFSIZ - 1);
+        BMG_Patlen = PAT_BUFSIZ;
+    }
+
+    BMG_Pattern = BMG_FullPat + BMG_AnchorOfs;
+
+    /* Without case folding BMG_Cmap is the identity map, so a candidate
+     * can be verified with one memcmp instead of a byte at a time
+     * through the table; the library compares a word per iteration
+     */
+    BMG_fExact = !fFolded;
+
+    /* Find the smallest period of the pattern. A periodic pattern, say a
+     * run of NULs, makes the naive verification loop go quadratic on
+     * input built from the same period: every position is a candidate
+     * and each one is re-verified from scratch. When a candidate
+     * overlaps the previous confirmed match by exactly one period the
+     * overlap is already known to equal the pattern, so the search
+     * functions only verify the bytes past that match (Galil's trick),
+     * which caps the work per input byte and keeps such scans linear.
+     * The resume only describes the whole pattern, so it is left off
+     * in anchored mode.
+     */
+    BMG_Period = 0;
+
+    if (!BMG_fAnchored)
+    {
+        for (p = 1; p < BMG_Patlen; p++)
+        {
+            for (i = p; i < BMG_Patlen && BMG_Pattern[i] == BMG_Pattern[i - p]; i++)
+                ;
+            if (i == BMG_Patlen)
+                break;
+        }
+
+        if (2 * p <= BMG_Patlen)
+            BMG_Period = p;
+    }
+
+    for (j = 0; j < 256; j++)
+    {
+        BMG_Delta0[j] = BMG_Patlen;
+        BMG_Cmap[j] = (unsigned char) j; /* could be done at compile time */
+    }
+
+    for (j = 0; j < BMG_Patlen - 1; j++)
+        BMG_Delta0[BMG_Pattern[j]] = BMG_Patlen - j - 1;
+
+    BMG_Delta0[BMG_Pattern[BMG_Patlen - 1]] = BMG_Large;
+
+    if (fFolded)
+    {
+        for (j = 0; j < BMG_Patlen - 1; j++)
+            if (islower((int) BMG_Pattern[j]))
+                BMG_Delta0[toupper((int) BMG_Pattern[j])] = BMG_Patlen - j - 1;
+        if (islower((int) BMG_Pattern[BMG_Patlen - 1]))
+            BMG_Delta0[toupper((int) BMG_Pattern[BMG_Patlen - 1])] = BMG_Large;
+        for (j = 'A'; j <= 'Z'; j++)
+            BMG_Cmap[j] = (unsigned char) tolower((int) j);
+    }
+
+    /* Decide between the delta table loop and a scan kernel. The
+     * kernels compare exact bytes so they cannot fold case. A one byte
+     * pattern is pure memchr; up to 4 bytes the memchr screen still
+     * beats the tiny delta hops; up to a vector width the rare byte
+     * kernel wins where the machine has one; past that the delta table
+     * skips further per memory access than any kernel can scan.
+     */
+    BMG_ScanFunc = NULL;
+
+    if (!fFolded && BMG_Patlen <= 32)
+    {
+        int RareOfs = 0;
+
+        for (j = 1; j < BMG_Patlen; j++)
+            if (ByteRank(BMG_Pattern[j]) < ByteRank(BMG_Pattern[RareOfs]))
+                RareOfs = j;
+
+        BMG_RareByte = BMG_Pattern[RareOfs];
+        BMG_RareBack = BMG_Patlen - 1 - RareOfs;
+
+        if (BMG_Patlen == 1)
+            BMG_ScanFunc = ScanByte;
+        else if (BMG_Patlen <= 4)
+            BMG_ScanFunc = ScanShort;
+#ifdef GSAR_SIMD
+        else
+            BMG_ScanFunc = __builtin_cpu_supports("avx2") ? SimdScanAVX2
+                                                          : SimdScanSSE2;
+#endif
+    }
+}
+
+
+/* State for the multi pattern engine. It uses a set extension of the
+ * Horspool idea: the shift table holds the smallest safe shift over all
+ * patterns, computed from the first MP_MinLen bytes of each, and a
+ * bucket per byte value chains the rules whose anchor byte (the byte at
+ * offset MP_MinLen - 1) has that value. All rules in a bucket share the
+ * same match start, so matches are discovered in file order and the
+ * rules keep their command line priority.
+ */
+static GSAR_RULE *MP_Rules;     /* the rule table */
+static int  MP_nRules;          /* number of rules */
+static int  MP_MinLen;          /* shortest search pattern */
+static int  MP_MaxLen;          /* longest search pattern */
+static int  MP_Shift[256];      /* smallest safe shift per byte value */
+static int  MP_Bucket[256];     /* first rule anchored on byte value, -1 none */
+static int *MP_Next;            /* next rule in the same bucket, -1 ends */
+
+
+/* Input    : pRules - table of search & replace rules
+ *            nRules - number of rules in the table
+ *            fFolded - flag which determines case folding
+ * Returns  : nothing
+ *
+ * Set up the shift table and anchor buckets for the multi pattern
+ * engine. The search patterns are folded in place when requested, the
+ * text side of the comparison is folded through BMG_Cmap just like in
+ * the single pattern engine.
+ */
+void BMG_SetupMulti(GSAR_RULE *pRules, int nRules, char fFolded)
+{
+    int i;
+    int j;
+    unsigned char c;
+
+    if (BMG_Buffer == NULL && (BMG_Buffer = BMG_AllocBuffer()) == NULL)
+        Abort("error, unable to allocate search buffer of %ld bytes", BMG_BufSiz);
+
+    MP_Rules = pRules;
+    MP_nRules = nRules;
+
+    MP_Next = (int *) malloc(nRules * sizeof(int));
+    if (MP_Next == NULL)
+        Abort("error, unable to allocate multi pattern state");
+
+    for (j = 0; j < 256; j++)
+        BMG_Cmap[j] = (unsigned char) j;
+
+    if (fFolded)
+    {
+        for (j = 'A'; j <= 'Z'; j++)
+            BMG_Cmap[j] = (unsigned char) tolower(j);
+
+        for (i = 0; i < nRules; i++)
+            for (j = 0; j < (int) pRules[i].nSearch; j++)
+                pRules[i].Search[j] = (char) BMG_Cmap[(unsigned char) pRules[i].Search[j]];
+    }
+
+    MP_MinLen = (int) pRules[0].nSearch;
+    MP_MaxLen = (int) pRules[0].nSearch;
+
+    for (i = 1; i < nRules; i++)
+    {
+        if ((int) pRules[i].nSearch < MP_MinLen)
+            MP_MinLen = (int) pRules[i].nSearch;
+        if ((int) pRules[i].nSearch > MP_MaxLen)
+            MP_MaxLen = (int) pRules[i].nSearch;
+    }
+
+    /* the carried tail between refills is derived from the longest rule */
+    if ((long) MP_MaxLen >= BMG_BufSiz)
+        Abort("error, the longest pattern must be shorter than the search buffer, raise the 'm' option");
+
+    for (j = 0; j < 256; j++)
+    {
+        MP_Shift[j] = MP_MinLen;
+        MP_Bucket[j] = -1;
+    }
+
+    for (i = 0; i < nRules; i++)
+    {
+        for (j = 0; j < MP_MinLen - 1; j++)
+        {
+            c = (unsigned char) pRules[i].Search[j];
+
+            if (MP_MinLen - 1 - j < MP_Shift[c])
+                MP_Shift[c] = MP_MinLen - 1 - j;
+            if (fFolded && isalpha((int) c))
+                MP_Shift[toupper((int) c)] = MP_Shift[c];
+        }
+    }
+
+    /* chain the rules onto their anchor byte, back to front so the
+     * bucket lists come out in rule order
+     */
+    for (i = nRules - 1; i >= 0; i--)
+    {
+        c = (unsigned char) pRules[i].Search[MP_MinLen - 1];
+
+        MP_Next[i] = MP_Bucket[c];
+        MP_Bucket[c] = i;
+        if (fFolded && isalpha((int) c))
+            MP_Bucket[toupper((int) c)] = i;
+    }
+}
+
+
+/* Input    : pRule - rule to verify
+ *            pStart - match start position in the buffer
+ *            strend - end of valid data in the buffer
+ * Returns  : 1 - the full search pattern matches at pStart
+ *            0 - no match
+ */
+static int MP_Match(GSAR_RULE *pRule, unsigned char *pStart, unsigned char *strend)
+{
+    unsigned int j;
+
+    if (pStart + pRule->nSearch > strend)
+        return 0;
+
+    for (j = 0; j < pRule->nSearch; j++)
+        if (BMG_Cmap[pStart[j]] != (unsigned char) pRule->Search[j])
+            return 0;
+
+    return 1;
+}
+
+
+/* Input    : pCtrl - pointer to structure containg output and ctrl info
+ * Returns  : number of matches found in file, over all rules
+ *
+ * The rules must already have been set up using BMG_SetupMulti
+ *
+ * Buffer management follows BMG_Search, with MP_MaxLen - 1 bytes moved
+ * to the start of the buffer between refills. The carried tail is
+ * scanned again since a longer rule's match starting there may have
+ * been cut off by the previous buffer end; only matches ending inside
+ * the tail, which the previous round did count, are suppressed.
+ */
+long BMG_MultiSearch(OUTPUT_CTRL *pCtrl)
+{
+    unsigned char *pos;
+    unsigned char *strend;
+    unsigned char c;
+
+    unsigned char *Buffer = (pCtrl->pBuffer != NULL) ? pCtrl->pBuffer : BMG_Buffer;
+
+    int  i;
+    int  nTrans = 0;   /* number of bytes to transfer to the start of the buffer */
+    long Cnt = BMG_BufSiz;
+
+    long nMatches = 0;                  /* number of matches found */
+    long nBytes;                        /* number of bytes read */
+    unsigned long long FileOfs = 0;     /* current file offset */
+
+    for (;;)
+    {
+        nBytes = fread(&Buffer[nTrans], 1, (size_t) Cnt, pCtrl->fpIn);
+
+        if (!nBytes)
+            break;
+
+        if (BMG_pfProgress != NULL)
+            (*BMG_pfProgress)((unsigned long long) nBytes);
+
+        strend = Buffer + nBytes + nTrans;
+
+        /* the carried tail is rescanned in full: a longer rule's match
+         * starting there may only now have all its bytes. Matches that
+         * also end inside the tail were counted in the previous round
+         * and are suppressed below.
+         */
+        pos = Buffer + MP_MinLen - 1;
+
+        while (pos < strend)
+        {
+            c = BMG_Cmap[*pos];
+
+            if (MP_Bucket[c] < 0)
+            {
+                pos += MP_Shift[c];
+                continue;
+            }
+
+            for (i = MP_Bucket[c]; i >= 0; i = MP_Next[i])
+            {
+                if (MP_Match(&MP_Rules[i], pos - MP_MinLen + 1, strend))
+                {
+                    if ((int) (pos - MP_MinLen + 1 - Buffer) +
+                        (int) MP_Rules[i].nSearch <= nTrans)
+                        continue;     /* already counted last round */
+
+                    nMatches++;
+                    if (pCtrl->fVerbose)
+                        Verbose(pCtrl, FileOfs, (int) (pos - MP_MinLen + 1 - Buffer),
+                                (int) MP_Rules[i].nSearch, Buffer, strend);
+
+                    if (BMG_MatchLimit != 0 && nMatches >= BMG_MatchLimit)
+                        break;
+                }
+            }
+
+            if (BMG_MatchLimit != 0 && nMatches >= BMG_MatchLimit)
+                break;
+
+            pos++;
+        }
+
+        if (BMG_MatchLimit != 0 && nMatches >= BMG_MatchLimit)
+            break;
+
+        nTrans = MP_MaxLen - 1;
+        if (nTrans > (int) (strend - Buffer))
+            nTrans = (int) (strend - Buffer);
+
+        memcpy(Buffer, strend - nTrans, nTrans); /* move remaining bytes to the start */
+        Cnt = BMG_BufSiz - nTrans;
+        FileOfs += Cnt;                          /* calculate file offset  */
+    }
+
+    return nMatches;
+}
+
+
+/* Input    : pCtrl - pointer to structure containg output and ctrl info
+ * Returns  : number of matches & replaces performed, over all rules
+ *            -1 if error in fwrite, disk might be full, or removed
+ *
+ * The rules must already have been set up using BMG_SetupMulti
+ *
+ * Applies every rule in a single read/write pass. Matches never overlap;
+ * the leftmost match wins and among rules matching at the same position
+ * the one given first wins. Buffer management follows BMG_SearchReplace
+ * with the carry derived from the longest rule; matches starting in the
+ * carried window are settled only once the bytes behind it are known,
+ * so rule priority does not depend on where the buffer ends.
+ */
+long BMG_MultiSearchReplace(OUTPUT_CTRL *pCtrl)
+{
+    unsigned char *pos;
+    unsigned char *strend;
+    unsigned char *pStart;
+    unsigned char *pLast;
+    unsigned char c;
+
+    unsigned char *Buffer = (pCtrl->pBuffer != NULL) ? pCtrl->pBuffer : BMG_Buffer;
+
+    GSAR_RULE *pRule;
+
+    int  i;
+    int  n;
+    int  nTrans = 0;   /* number of bytes to transfer to the start of the buffer */
+    int  fFinal;       /* no more bytes follow the current buffer */
+    long Cnt = BMG_BufSiz;
+
+    long nMatches = 0;                       /* number of matches found */
+    long nBytes;                             /* number of bytes read */
+    unsigned long long FileOfs = 0;          /* current file offset */
+
+    for (;;)
+    {
+        nBytes = fread(&Buffer[nTrans], 1, (size_t) Cnt, pCtrl->fpIn);
+
+        fFinal = !nBytes || feof(pCtrl->fpIn);
+
+        if (!nBytes && nTrans == 0)
+            break;
+
+        if (nBytes && BMG_pfProgress != NULL)
+            (*BMG_pfProgress)((unsigned long long) nBytes);
+
+        pLast = Buffer;
+        strend = Buffer + nBytes + nTrans;
+
+        pos = Buffer + MP_MinLen - 1;
+
+        while (pos < strend)
+        {
+            c = BMG_Cmap[*pos];
+
+            if (MP_Bucket[c] < 0)
+            {
+                pos += MP_Shift[c];
+                continue;
+            }
+
+            pStart = pos - MP_MinLen + 1;
+            pRule = NULL;
+
+            if (pStart >= pLast)
+            {
+                for (i = MP_Bucket[c]; i >= 0; i = MP_Next[i])
+                {
+                    if (MP_Match(&MP_Rules[i], pStart, strend))
+                    {
+                        pRule = &MP_Rules[i];
+                        break;
+                    }
+                }
+            }
+
+            if (pRule == NULL)
+            {
+                pos++;
+                continue;
+            }
+
+            /* mid stream a match starting in the last MP_MaxLen - 1
+             * bytes is not settled: a longer, earlier listed rule could
+             * claim the same start once the next refill supplies its
+             * missing bytes. Leave that window to the carried tail and
+             * decide there; all later starts lie in the window too.
+             */
+            if (!fFinal && pStart + MP_MaxLen > strend)
+                break;
+
+            nMatches++;
+            if (pCtrl->fVerbose)
+                Verbose(pCtrl, FileOfs, (int) (pStart - Buffer),
+                        (int) pRule->nSearch, Buffer, strend);
+
+            n = (int) (pStart - pLast);
+            if (fwrite(pLast, 1, n, pCtrl->fpOut) != (size_t) n)
+                return -1;
+            if (fwrite(pRule->Replace, 1, pRule->nReplace, pCtrl->fpOut) != pRule->nReplace)
+                return -1;
+
+            pLast = pStart + pRule->nSearch;
+            pos = pLast + MP_MinLen - 1;
+        }
+
+        n = (int) (strend - pLast);
+
+        if (fFinal)
+        {
+            if (fwrite(pLast, 1, n, pCtrl->fpOut) != (size_t) n)
+                return -1;
+            break;
+        }
+
+        if (n >= MP_MaxLen)
+        {
+            if (fwrite(pLast, 1, n - MP_MaxLen + 1, pCtrl->fpOut) != (size_t) (n - MP_MaxLen + 1))
+                return -1;
+            nTrans = MP_MaxLen - 1;
+        }
+        else
+        {
+            nTrans = n;
+        }
+
+        memcpy(Buffer, strend - nTrans, nTrans); /* move remaining bytes to the start */
+
+        Cnt = BMG_BufSiz - nTrans;
+        FileOfs += Cnt;  /* calculate file offset  */
+    }
+
+    return nMatches;
+}
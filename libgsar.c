@@ -0,0 +1,295 @@
+/* libgsar.c
+ *
+ * Embeddable context form of the gsar BMG search engine
+ *
+ * The algorithm is the one the tool runs, see gsarbmg.c for its
+ * lineage: a Boyer/Moore/Gosper delta table skip loop with memcmp
+ * verification when case is significant, a folding map when it is
+ * not, and Galil's resume for periodic patterns so pathological
+ * input stays linear. The difference is purely structural: all state
+ * lives in a context, data arrives through a feed call instead of a
+ * stream, and matches leave through a callback instead of stdio.
+ *
+ * A match can span a chunk seam, so the context carries the last
+ * pattern length minus one bytes of the stream. Each feed first scans
+ * that tail glued to the front of the new chunk, reporting only the
+ * matches that straddle the seam, then scans the chunk in place; no
+ * byte of a chunk is ever copied except into the carried tail.
+ *
+ * Copyright (C) 1992-2020 Tormod Tjaberg
+ * This is free software, distributed under the terms of the
+ * GNU General Public License. For details see the file COPYING
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "libgsar.h"
+
+struct gsar_ctx
+{
+    unsigned char *pPat;          /* the pattern, folded when requested */
+    unsigned int   nPat;          /* its length */
+    int    Delta0[256];           /* skip table */
+    unsigned char  Cmap[256];     /* text side folding map */
+    int    Stop;                  /* sentinel delta marking the last byte */
+    int    Period;                /* smallest period when the pattern is
+                                   * periodic, else 0 */
+    int    fExact;                /* no folding, verify with memcmp */
+
+    unsigned char *pTail;         /* last nPat - 1 bytes of the stream */
+    unsigned int   nTail;         /* bytes in the tail */
+    unsigned char *pSeam;         /* tail plus chunk head scratch block */
+
+    unsigned long long StreamOfs; /* offset of the next byte to be fed */
+    unsigned long long nMatches;  /* matches in the current stream */
+
+    GSAR_MATCH_FUNC pfMatch;
+    void  *pUser;
+};
+
+/* Input  : pCtx - the search context
+ *          pMem - block of stream bytes to scan
+ *          nLen - number of bytes in the block
+ *          BaseOfs - stream offset of the first byte of the block
+ *          HiStart - report only matches starting before this offset
+ *                    within the block
+ *
+ * The block form of the skip loop, as in BMG_SearchMem: the delta walk
+ * stops on the sentinel value instead of overshooting, since the block
+ * is not ours to pad. Matches outside the report window still feed the
+ * periodic resume, they are just not delivered twice.
+ */
+static void ScanBlock(GSAR_CTX *pCtx, const unsigned char *pMem, size_t nLen,
+                      unsigned long long BaseOfs, size_t HiStart)
+{
+    const unsigned char *k;
+    const unsigned char *s;
+    const unsigned char *strend;
+    const unsigned char *pResume = NULL;
+    size_t MatchOfs;
+    int j;
+
+    if (nLen < (size_t) pCtx->nPat)
+        return;
+
+    strend = pMem + nLen;
+    k = pMem + pCtx->nPat - 1;
+
+    for (;;)
+    {
+        while (k < strend && (j = pCtx->Delta0[*k]) != pCtx->Stop)
+            k += j;
+
+        if (k >= strend)
+            break;
+
+        if (pCtx->Period != 0 && pResume != NULL &&
+            k - pResume == pCtx->Period)
+        {
+            /* the candidate overlaps the previous match by one period,
+             * so only the bytes past that match can differ
+             */
+            for (j = 1; j < pCtx->Period; j++)
+                if (pCtx->Cmap[k[-j]] != pCtx->pPat[pCtx->nPat - 1 - j])
+                    break;
+            j = (j == pCtx->Period) ? -1 : j;
+        }
+        else if (pCtx->fExact)
+            j = (memcmp(k - pCtx->nPat + 1, pCtx->pPat,
+                        (size_t) pCtx->nPat) == 0) ? -1 : 0;
+        else
+        {
+            j = (int) pCtx->nPat - 2;
+            s = k - 1;
+
+            while (j >= 0 && pCtx->Cmap[*s] == pCtx->pPat[j])
+            {
+                s--;
+                j--;
+            }
+        }
+
+        if (j >= 0)
+            k++;
+        else
+        {
+            MatchOfs = (size_t) (k - pMem) + 1 - pCtx->nPat;
+            pResume = k;
+
+            if (MatchOfs < HiStart)
+            {
+                pCtx->nMatches++;
+                if (pCtx->pfMatch != NULL)
+                    (*pCtx->pfMatch)(pCtx->pUser, BaseOfs + MatchOfs);
+            }
+
+            k++;
+        }
+    }
+}
+
+GSAR_CTX *GsarCreate(const void *pPattern, unsigned int nPattern,
+                     int fFolded, GSAR_MATCH_FUNC pfMatch, void *pUser)
+{
+    GSAR_CTX *pCtx;
+    const unsigned char *pat = (const unsigned char *) pPattern;
+    unsigned int j, p, i;
+
+    if (nPattern == 0)
+        return NULL;
+
+    if ((pCtx = (GSAR_CTX *) calloc(1, sizeof(GSAR_CTX))) == NULL)
+        return NULL;
+
+    pCtx->nPat = nPattern;
+    pCtx->pPat = (unsigned char *) malloc(nPattern);
+
+    /* the seam block holds the tail and a pattern head: a straddling
+     * match needs at most nPat - 1 bytes from either side
+     */
+    if (nPattern > 1)
+    {
+        pCtx->pTail = (unsigned char *) malloc(nPattern - 1);
+        pCtx->pSeam = (unsigned char *) malloc(2 * (nPattern - 1));
+    }
+
+    if (pCtx->pPat == NULL ||
+        (nPattern > 1 && (pCtx->pTail == NULL || pCtx->pSeam == NULL)))
+    {
+        GsarDestroy(pCtx);
+        return NULL;
+    }
+
+    if (fFolded)
+    {
+        for (j = 0; j < nPattern; j++)
+            pCtx->pPat[j] = (isupper((int) pat[j])
+                             ? (unsigned char) tolower((int) pat[j]) : pat[j]);
+    }
+    else
+        memcpy(pCtx->pPat, pat, nPattern);
+
+    pCtx->fExact = !fFolded;
+
+    /* smallest period, for the linear time resume on periodic patterns */
+    pCtx->Period = 0;
+
+    for (p = 1; p < nPattern; p++)
+    {
+        for (i = p; i < nPattern && pCtx->pPat[i] == pCtx->pPat[i - p]; i++)
+            ;
+        if (i == nPattern)
+            break;
+    }
+
+    if (2 * p <= nPattern)
+        pCtx->Period = (int) p;
+
+    /* the sentinel only has to be distinct from every real skip */
+    pCtx->Stop = (int) nPattern + 1;
+
+    for (j = 0; j < 256; j++)
+    {
+        pCtx->Delta0[j] = (int) nPattern;
+        pCtx->Cmap[j] = (unsigned char) j;
+    }
+
+    for (j = 0; j < nPattern - 1; j++)
+        pCtx->Delta0[pCtx->pPat[j]] = (int) (nPattern - j - 1);
+
+    pCtx->Delta0[pCtx->pPat[nPattern - 1]] = pCtx->Stop;
+
+    if (fFolded)
+    {
+        for (j = 0; j < nPattern - 1; j++)
+            if (islower((int) pCtx->pPat[j]))
+                pCtx->Delta0[toupper((int) pCtx->pPat[j])] = (int) (nPattern - j - 1);
+        if (islower((int) pCtx->pPat[nPattern - 1]))
+            pCtx->Delta0[toupper((int) pCtx->pPat[nPattern - 1])] = pCtx->Stop;
+        for (j = 'A'; j <= 'Z'; j++)
+            pCtx->Cmap[j] = (unsigned char) tolower((int) j);
+    }
+
+    pCtx->pfMatch = pfMatch;
+    pCtx->pUser = pUser;
+
+    return pCtx;
+}
+
+void GsarFeed(GSAR_CTX *pCtx, const void *pData, size_t nData)
+{
+    const unsigned char *p = (const unsigned char *) pData;
+    size_t Ovl = pCtx->nPat - 1;
+    size_t Take;
+    size_t Keep;
+
+    if (nData == 0)
+        return;
+
+    if (pCtx->nTail > 0)
+    {
+        /* scan the seam: the carried tail glued to the head of the
+         * chunk. Only matches starting in the tail are reported here,
+         * and every one of those straddles the glue point: the tail is
+         * shorter than the pattern, so nothing fits inside it, and
+         * matches entirely in the chunk belong to the in place scan
+         * below.
+         */
+        Take = (nData < Ovl) ? nData : Ovl;
+        memcpy(pCtx->pSeam + pCtx->nTail, p, Take);
+
+        ScanBlock(pCtx, pCtx->pSeam, pCtx->nTail + Take,
+                  pCtx->StreamOfs - pCtx->nTail, pCtx->nTail);
+    }
+
+    ScanBlock(pCtx, p, nData, pCtx->StreamOfs, nData);
+
+    /* carry the last Ovl bytes of the stream into the tail, shifting
+     * what is already there when the chunk alone cannot fill it
+     */
+    if (Ovl > 0)
+    {
+        if (nData >= Ovl)
+        {
+            memcpy(pCtx->pTail, p + nData - Ovl, Ovl);
+            pCtx->nTail = (unsigned int) Ovl;
+        }
+        else
+        {
+            Keep = Ovl - nData;
+            if (Keep > pCtx->nTail)
+                Keep = pCtx->nTail;
+
+            memmove(pCtx->pTail, pCtx->pTail + pCtx->nTail - Keep, Keep);
+            memcpy(pCtx->pTail + Keep, p, nData);
+            pCtx->nTail = (unsigned int) (Keep + nData);
+        }
+
+        memcpy(pCtx->pSeam, pCtx->pTail, pCtx->nTail);
+    }
+
+    pCtx->StreamOfs += nData;
+}
+
+unsigned long long GsarEnd(GSAR_CTX *pCtx)
+{
+    unsigned long long n = pCtx->nMatches;
+
+    pCtx->nTail = 0;
+    pCtx->StreamOfs = 0;
+    pCtx->nMatches = 0;
+
+    return n;
+}
+
+void GsarDestroy(GSAR_CTX *pCtx)
+{
+    if (pCtx == NULL)
+        return;
+
+    free(pCtx->pPat);
+    free(pCtx->pTail);
+    free(pCtx->pSeam);
+    free(pCtx);
+}
@@ -0,0 +1,59 @@
+/* libgsar.h
+ *
+ * Embeddable interface to the gsar search engine
+ * Author      : Tormod Tjaberg
+ *
+ * The gsar executable is welded to its command line: engine state in
+ * globals, streams in the control structure, matches delivered as
+ * formatted text. This interface carries everything in a context so a
+ * host program can run any number of independent searches without
+ * forking the tool: create a context per pattern, feed the data as it
+ * arrives in chunks of any size, and take the matches through a
+ * callback. Compile libgsar.c into the host program or archive it as
+ * libgsar.a; it depends on nothing beyond the C library.
+ */
+
+#ifndef LIBGSAR_H
+#define LIBGSAR_H
+
+#include <stddef.h>
+
+typedef struct gsar_ctx GSAR_CTX;
+
+/* Called once per match with the absolute stream offset of its first
+ * byte. Matches arrive in stream order; overlapping occurrences are
+ * all reported, exactly as the tool counts them.
+ */
+typedef void (*GSAR_MATCH_FUNC)(void *pUser, unsigned long long Ofs);
+
+/* Input  : pPattern - pattern bytes, any values including NUL
+ *          nPattern - length of the pattern in bytes
+ *          fFolded - nonzero folds case like the tool's 'i' option
+ *          pfMatch - match callback, NULL just counts
+ *          pUser - handed back untouched on every callback
+ * Returns: a fresh context, NULL if out of memory or nPattern is 0
+ */
+GSAR_CTX *GsarCreate(const void *pPattern, unsigned int nPattern,
+                     int fFolded, GSAR_MATCH_FUNC pfMatch, void *pUser);
+
+/* Input  : pData - next chunk of the stream, any size including 0
+ *          nData - length of the chunk in bytes
+ *
+ * Scans the chunk as a continuation of everything fed before it.
+ * Matches spanning chunk seams are found through a carried tail of
+ * pattern length minus one bytes; the chunk itself is scanned in
+ * place and never copied.
+ */
+void GsarFeed(GSAR_CTX *pCtx, const void *pData, size_t nData);
+
+/* Returns: number of matches in the stream just ended
+ *
+ * Ends the current stream and resets the context for the next one;
+ * the pattern tables are kept, so a context can serve a stream after
+ * stream without being rebuilt.
+ */
+unsigned long long GsarEnd(GSAR_CTX *pCtx);
+
+void GsarDestroy(GSAR_CTX *pCtx);
+
+#endif /* LIBGSAR_H */